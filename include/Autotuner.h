@@ -0,0 +1,63 @@
+#ifndef AUTOTUNER_H
+#define AUTOTUNER_H
+
+#include "Convolution.h"
+#include <string>
+
+// 卷积策略自动调优：第一次遇到某个形状（核尺寸与非零/分组/可分离特征、图像尺寸、步长、
+// 填充方式、线程数）时，把该输入上 KernelPlan 支持的各策略都跑一遍并计时，记住最快的；
+// 之后同一形状直接使用缓存结果。结果可保存到配置文件，供以后的运行与其他进程直接读取。
+// KernelPlan 自身的启发式选择只依据操作数估计，这里依据的是本机实测时间。
+class Autotuner {
+private:
+    // 已调优的形状：keys[i] 的最快策略为 winners[i]，耗时 seconds[i]
+    Vector<string> keys;
+    Vector<int> winners;
+    Vector<double> seconds;
+
+    string profilePath;         // 非空时，每次新调优后写回该文件
+    int repetitions;            // 每个候选策略计时的次数（取最短）
+    bool forced;
+    KernelPlan::Strategy forcedStrategy;
+
+    static string shapeKey(const KernelPlan& plan, const ImageView& input, int stride,
+                           Convolution::PaddingMode padding);
+    int find(const string& key) const;
+    void record(const string& key, KernelPlan::Strategy strategy, double elapsed);
+
+public:
+    Autotuner();
+    // 从 path 读取已有的配置（文件不存在时从空开始），之后的调优结果写回 path
+    explicit Autotuner(const string& path);
+
+    // 配置文件为文本，每行 "形状 策略名 秒数"，# 开头为注释；读取时与内存中的结果合并
+    bool loadProfile(const string& path);
+    // 先写本进程独有的临时文件再替换目标文件，其他进程不会读到写了一半的文件
+    bool saveProfile(const string& path) const;
+
+    // 每个候选计时次数；小于 1 时抛出 -1
+    void setRepetitions(int n) throw(int);
+
+    // 强制使用某个策略（跳过计时与缓存），便于复现结果；KernelPlan 不支持时按
+    // Convolution::execute 的规则退回其他路径
+    void forceStrategy(KernelPlan::Strategy strategy);
+    void clearForcedStrategy();
+    bool isForced() const { return forced; }
+
+    // 返回该形状的最快策略；未调优过时返回 plan 自身的选择
+    KernelPlan::Strategy lookup(const KernelPlan& plan, const ImageView& input, int stride,
+                                Convolution::PaddingMode padding) const;
+
+    // 用 conv 的卷积核、步长与填充方式卷积 input。新形状会先调优，计时时最快候选的输出直接作为结果返回。
+    // 派生类（SobelDetector、MedianFilter 等）的结果不由卷积核决定，直接调用其 apply，不做调优
+    Image apply(const Convolution& conv, const ImageView& input);
+    Image apply(const KernelPlan& plan, const ImageView& input, int stride, Convolution::PaddingMode padding);
+
+    int getEntryCount() const { return keys.getsize(); }
+
+    static const char* strategyName(KernelPlan::Strategy strategy);
+    // 未知名称时抛出 -1
+    static KernelPlan::Strategy parseStrategy(const string& name) throw(int);
+};
+
+#endif
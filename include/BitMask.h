@@ -0,0 +1,58 @@
+#ifndef BITMASK_H
+#define BITMASK_H
+
+#include "Image.h"
+#include <stdint.h>
+#include <string>
+
+// 位压缩的二值掩码：每像素 1 位，每个 64 位字存 64 个像素（低位在左）。
+// 每行从新的字开始，行尾多余的位始终为 0，因此按字做 AND/OR/XOR/popcount 都无需特殊处理。
+// 置位表示该像素为 255（与阈值化后的 Image 含义相同）。
+class BitMask {
+private:
+    int rows;
+    int cols;
+    int wordsPerRow;
+    Vector<uint64_t> words;
+
+    // 行尾有效位的掩码（cols 为 64 的倍数时为全 1）
+    uint64_t tailMask() const;
+
+public:
+    BitMask(int r = 0, int c = 0);
+
+    int getRows() const { return rows; }
+    int getCols() const { return cols; }
+    int getWordsPerRow() const { return wordsPerRow; }
+
+    bool get(int r, int c) const throw(int);
+    void set(int r, int c, bool value) throw(int);
+
+    // 不做边界检查的行访问（供热点循环使用）
+    uint64_t* rowWords(int r) { return &words[0] + (long)r * wordsPerRow; }
+    const uint64_t* rowWords(int r) const { return &words[0] + (long)r * wordsPerRow; }
+
+    // 按字运算；尺寸不一致时抛出 -1.0
+    BitMask& operator&=(const BitMask& other) throw(double);
+    BitMask& operator|=(const BitMask& other) throw(double);
+    BitMask& operator^=(const BitMask& other) throw(double);
+    BitMask operator&(const BitMask& other) const throw(double);
+    BitMask operator|(const BitMask& other) const throw(double);
+    BitMask operator^(const BitMask& other) const throw(double);
+    BitMask operator~() const;
+
+    // 置位像素数
+    long popcount() const;
+
+    // value > threshold 的像素置位（SSE2 一次比较两个像素）
+    static BitMask fromImage(const ImageView& image, double threshold = 127.5);
+    // 置位为 255，其余为 0
+    Image toImage() const;
+
+    // P4（二进制 PBM）：每像素 1 位，约为 P2 文本的 1/32。PBM 中 1 表示黑色，
+    // 所以写出时取反，保存的图像与同一结果用 savePGM 保存时外观一致。
+    bool savePBM(const string& filename) const;
+    bool loadPBM(const string& filename);
+};
+
+#endif
@@ -3,6 +3,7 @@
 
 #include "Image.h"
 #include "Matrix.h"
+#include "KernelPlan.h"
 
 class Convolution {
 public:
@@ -14,6 +15,7 @@ public:
 
 protected:
     Matrix kernel;
+    KernelPlan plan;        // setKernel 时编译，apply 时直接使用
     int stride;
     PaddingMode paddingMode;
 
@@ -25,7 +27,41 @@ public:
     void setStride(int s);
     void setPadding(PaddingMode p);
 
-    virtual Image apply(const Image& input) const;
+    // 接受 Image 或 ImageView（Image 隐式转换为整幅视图）；派生类应重写此版本
+    virtual Image apply(const ImageView& input) const;
+    // 以 Image 为参数的旧接口，转发到视图版本。只重写了此版本的旧派生类以 Image 调用时
+    // 仍然生效（以视图调用时不经过该重写）
+    virtual Image apply(const Image& input) const { return apply(ImageView(input)); }
+
+    // 输出像素 (i, j) 只依赖以 (i, j) 为中心、该半径内的输入（步长为 1 时），供增量处理确定重算范围
+    virtual int getRadius() const;
+    // 对这幅输入，输出只依赖上述邻域时为 true；依赖整幅图像（如自动阈值，或按整幅图像
+    // 是否为 8 位整数选择计算路径）时为 false
+    virtual bool isLocal(const ImageView& input) const { (void)input; return true; }
+
+    const KernelPlan& getPlan() const { return plan; }
+    int getStride() const { return stride; }
+    PaddingMode getPadding() const { return paddingMode; }
+
+    // 按已编译的卷积核执行卷积（供固定核的派生类复用，无需每次重建 Convolution 对象）
+    static Image execute(const KernelPlan& plan, const ImageView& input, int stride, PaddingMode padding);
+    // 同上，但用指定的策略代替 plan 选定的策略（供 Autotuner 计时与强制策略使用）
+    static Image execute(const KernelPlan& plan, KernelPlan::Strategy strategy, const ImageView& input,
+                         int stride, PaddingMode padding);
+
+    // 按填充方式把输入复制到 (rows + 2*padH) x (cols + 2*padW) 的连续缓冲区（同时应用待定的归一化）
+    static void padInput(const ImageView& input, int padH, int padW, PaddingMode mode, Vector<double>& out);
+
+    // 同上，输出 8 位缓冲区（供整数快速路径使用）；遇到不是 0-255 整数的像素时返回 false
+    static bool padInput8Bit(const ImageView& input, int padH, int padW, PaddingMode mode,
+                             Vector<unsigned char>& out);
+
+    // 像素（应用待定的归一化后）是否都是 0-255 的整数
+    static bool is8Bit(const ImageView& input);
+
+    // 把一行 8 位（或 double）中间结果写入输出行
+    static void storeRow(const unsigned char* src, int n, double* dst);
+    static void storeRow(const double* src, int n, double* dst);
 
     // Static helpers to create common kernels
     static Matrix createIdentityKernel(int size);
@@ -0,0 +1,46 @@
+#ifndef FILTERBANK_H
+#define FILTERBANK_H
+
+#include "Convolution.h"
+
+// 滤波器组：把 N 个同尺寸的卷积核在一次遍历中作用于同一幅输入，输出 N 个平面。
+// 每个邻域只读取一次，再与所有卷积核分别求点积。
+class FilterBank {
+public:
+    enum Method {
+        Method_Auto,            // 自动选择：步长 1 的 3x3/5x5/7x7 核用展开的定长路径，其余用 Neighbourhood
+        Method_Neighbourhood,   // 逐像素读取邻域，依次与各核求点积（显式指定时各种尺寸都走此路径）
+        Method_Im2col           // 按像素块展开为矩阵，与权重矩阵做分块乘法（Matrix::multiplyInto）；
+                                // 从不自动选择，实测在各种组规模下都慢于以上两者
+    };
+
+private:
+    int kRows;
+    int kCols;
+    int count;
+    Matrix weights;             // count x (kRows*kCols)，第 f 行为第 f 个核的展平抽头
+    int stride;
+    Convolution::PaddingMode paddingMode;
+    Method method;
+
+    void applyNeighbourhood(const double* padded, int pw, int stride, Image outputs[]) const;
+    void applyIm2col(const double* padded, int pw, int stride, Image outputs[]) const;
+
+public:
+    FilterBank(int s = 1, Convolution::PaddingMode p = Convolution::Padding_Zero);
+
+    // 添加卷积核；尺寸须与已有的核一致，否则抛出 -1
+    void addKernel(const Matrix& k) throw(int);
+    void clear();
+    int getKernelCount() const { return count; }
+
+    void setStride(int s);
+    void setPadding(Convolution::PaddingMode p);
+    void setMethod(Method m);
+
+    // outputs 至少要有 getKernelCount() 个元素，第 f 个输出对应第 f 个核
+    void apply(const ImageView& input, Image outputs[]) const;
+    void apply(const ImageView& input, Image outputs[], int s, Convolution::PaddingMode p) const;
+};
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef FIXEDTAPSUM_H
+#define FIXEDTAPSUM_H
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Compile-time unrolled tap sum for a K x K kernel over K padded rows, shared by
+// Convolution's and FilterBank's fixed-size paths. Terms are added in row-major
+// tap order, so results are bit-identical to a plain tap-by-tap loop.
+template <int K, int T>
+struct FixedTapSum {
+    static inline double run(const double* const* rows, int j, const double* w) {
+        return FixedTapSum<K, T - 1>::run(rows, j, w) + w[T - 1] * rows[(T - 1) / K][j + (T - 1) % K];
+    }
+#ifdef __SSE2__
+    static inline __m128d run2(const double* const* rows, int j, const __m128d* w) {
+        return _mm_add_pd(FixedTapSum<K, T - 1>::run2(rows, j, w),
+                          _mm_mul_pd(w[T - 1], _mm_loadu_pd(rows[(T - 1) / K] + j + (T - 1) % K)));
+    }
+#endif
+};
+
+template <int K>
+struct FixedTapSum<K, 0> {
+    static inline double run(const double* const*, int, const double*) { return 0.0; }
+#ifdef __SSE2__
+    static inline __m128d run2(const double* const*, int, const __m128d*) { return _mm_setzero_pd(); }
+#endif
+};
+
+#ifdef __SSE2__
+// Bank form, one kernel row at a time: each of the N taps of output pixels j
+// and j + 1 is loaded once and multiplied into G accumulators, one per kernel,
+// so the neighbourhood is read once per group rather than once per kernel.
+// Kernel g's weights for this row start at w[g * K * K]. Called for rows 0 to
+// K - 1 in order, each accumulator adds its taps in the same order as
+// FixedTapSum, so results are bit-identical to it. Unrolling a single row keeps
+// the compiler from hoisting the whole K x K patch into spilled registers.
+template <int K, int N, int G>
+struct FixedBankRow {
+    static inline void run2(const double* row, const __m128d* w, __m128d* acc) {
+        FixedBankRow<K, N - 1, G>::run2(row, w, acc);
+        __m128d v = _mm_loadu_pd(row + N - 1);
+        for (int g = 0; g < G; ++g) {
+            acc[g] = _mm_add_pd(acc[g], _mm_mul_pd(w[g * K * K + N - 1], v));
+        }
+    }
+};
+
+template <int K, int G>
+struct FixedBankRow<K, 0, G> {
+    static inline void run2(const double*, const __m128d*, __m128d*) {}
+};
+#endif
+
+#endif // FIXEDTAPSUM_H
@@ -5,11 +5,146 @@
 #include <string>
 #include <fstream>
 #include <iostream>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 
+class ImageView;
+
+// 像素数低于此值时 OpenMP 的 fork/join 开销大于收益，各处并行循环均以此为阈值
+static const long kParallelPixels = 65536;
+
+// 把一行像素按 (v - minVal) / range * 255 映射到 0-255（src 与 dst 可以相同）
+inline void normalizeRow(const double* src, double* dst, int w, double minVal, double range) {
+    int j = 0;
+#ifdef __SSE2__
+    __m128d vmin = _mm_set1_pd(minVal);
+    __m128d vrange = _mm_set1_pd(range);
+    __m128d v255 = _mm_set1_pd(255.0);
+    for (; j + 2 <= w; j += 2) {
+        __m128d v = _mm_loadu_pd(src + j);
+        _mm_storeu_pd(dst + j, _mm_mul_pd(_mm_div_pd(_mm_sub_pd(v, vmin), vrange), v255));
+    }
+#endif
+    for (; j < w; ++j) {
+        dst[j] = (src[j] - minVal) / range * 255.0;
+    }
+}
+
 class Image : public Matrix {
+public:
+    // resizeImage 的插值方式（质量/速度档位）
+    enum ResizeFilter {
+        Resize_Nearest,     // 最近邻：最快
+        Resize_Bilinear,    // 双线性：像素中心对齐
+        Resize_Area         // 区域平均：缩小时按覆盖面积加权，抗混叠
+    };
+
 private:
+    // 一维重采样表：输出位置 i 取源像素 start[i] .. start[i]+taps-1 加权求和。
+    // 权重按相邻两个输出交错存放（weights[(i/2)*2*taps + 2*k + i%2]），便于 SIMD 一次算两个输出。
+    struct ResampleTable {
+        Vector<int> start;
+        Vector<double> weights;
+        int taps;
+    };
+
+    static void buildResampleTable(int inSize, int outSize, ResizeFilter filter, ResampleTable& table) {
+        double scale = (double)inSize / outSize;
+        int taps;
+        if (filter == Resize_Bilinear) {
+            taps = 2;
+        } else {
+            taps = (int)ceil(scale) + 1;
+        }
+        if (taps > inSize) taps = inSize;
+
+        int pairs = (outSize + 1) / 2;
+        table.taps = taps;
+        table.start.resize(pairs * 2);
+        table.weights.resize(pairs * 2 * taps);
+        for (int i = 0; i < pairs * 2 * taps; ++i) {
+            table.weights[i] = 0.0;
+        }
+
+        for (int i = 0; i < pairs * 2; ++i) {
+            int o = (i < outSize) ? i : outSize - 1;   // odd tail duplicates the last output
+            double* w = &table.weights[(i / 2) * 2 * taps + (i % 2)];
+            int first;
+            if (filter == Resize_Bilinear) {
+                double src = (o + 0.5) * scale - 0.5;
+                if (src < 0) src = 0;
+                first = (int)src;
+                double frac = src - first;
+                if (first > inSize - taps) {
+                    first = inSize - taps;
+                    frac = (taps > 1) ? 1.0 : 0.0;
+                }
+                w[0] = (taps > 1) ? 1.0 - frac : 1.0;
+                if (taps > 1) w[2] = frac;
+            } else {
+                // Area: weight = overlap of [o*scale, (o+1)*scale) with each source pixel
+                double s0 = o * scale;
+                double s1 = (o + 1) * scale;
+                first = (int)s0;
+                if (first > inSize - taps) first = inSize - taps;
+                for (int k = 0; k < taps; ++k) {
+                    double lo = first + k > s0 ? first + k : s0;
+                    double hi = first + k + 1 < s1 ? first + k + 1 : s1;
+                    w[2 * k] = hi > lo ? (hi - lo) / scale : 0.0;
+                }
+            }
+            table.start[i] = first;
+        }
+    }
+
+    // 水平方向：按表对一行重采样
+    static void resampleRow(const double* src, const ResampleTable& table, int outSize, double* dst) {
+        int taps = table.taps;
+        const int* start = &table.start[0];
+        const double* weights = &table.weights[0];
+        int j = 0;
+#ifdef __SSE2__
+        for (; j + 2 <= outSize; j += 2) {
+            const double* a = src + start[j];
+            const double* b = src + start[j + 1];
+            const double* w = weights + (j / 2) * 2 * taps;
+            __m128d sum = _mm_setzero_pd();
+            for (int k = 0; k < taps; ++k) {
+                sum = _mm_add_pd(sum, _mm_mul_pd(_mm_set_pd(b[k], a[k]), _mm_loadu_pd(w + 2 * k)));
+            }
+            _mm_storeu_pd(dst + j, sum);
+        }
+#endif
+        for (; j < outSize; ++j) {
+            const double* a = src + start[j];
+            const double* w = weights + (j / 2) * 2 * taps + (j % 2);
+            double sum = 0.0;
+            for (int k = 0; k < taps; ++k) {
+                sum += a[k] * w[2 * k];
+            }
+            dst[j] = sum;
+        }
+    }
+
+    // 垂直方向：dst += w * src（整行）
+    static void accumulateRow(const double* src, double w, int n, double* dst) {
+        int j = 0;
+#ifdef __SSE2__
+        __m128d vw = _mm_set1_pd(w);
+        for (; j + 2 <= n; j += 2) {
+            _mm_storeu_pd(dst + j, _mm_add_pd(_mm_loadu_pd(dst + j), _mm_mul_pd(vw, _mm_loadu_pd(src + j))));
+        }
+#endif
+        for (; j < n; ++j) {
+            dst[j] += w * src[j];
+        }
+    }
+
     void skipComments(ifstream& file) {
         char c;
         while (true) {
@@ -27,6 +162,9 @@ public:
     // 构造函数
     Image(int h = 0, int w = 0) : Matrix(h, w) {}
 
+    // 由视图复制出一幅独立的图像（等价于 view.materialize()）
+    explicit Image(const ImageView& view);
+
     virtual void printInfo() const {
         cout << "Image (" << rows << "x" << cols << ")" << endl;
     }
@@ -102,28 +240,9 @@ public:
     }
 
     // 保存 PGM (P2)
-    bool savePGM(const string& filename) const {
-        ofstream file(filename.c_str());
-        if (!file) return false;
-
-        file << "P2" << endl;
-        file << getCols() << " " << getRows() << endl;
-        file << "255" << endl;
-
-        for (int i = 0; i < getRows(); ++i) {
-            for (int j = 0; j < getCols(); ++j) {
-                double val = getElement(i, j);
-                int pixel = (int)val;
-                if (pixel < 0) pixel = 0;
-                if (pixel > 255) pixel = 255;
-                file << pixel << (j == getCols() - 1 ? "" : " ");
-            }
-            file << endl;
-        }
-        return true;
-    }
+    bool savePGM(const string& filename) const;
 
-    // 裁剪
+    // 裁剪（复制出独立的图像，超出原图的部分补 0）
     Image crop(int x, int y, int w, int h) const {
         Image res(h, w);
         for (int i = 0; i < h; ++i) {
@@ -136,48 +255,304 @@ public:
         return res;
     }
 
-    // 调整大小 (最近邻插值)
-    Image resizeImage(int new_w, int new_h) const {
+    // O(1) 返回引用原图像素的视图（区域超出原图的部分被截去，起点越界时抛出 -1）。
+    // 视图不拥有像素：不要对临时 Image 取视图，源图像改变尺寸或被销毁后视图失效。
+    // 需要独立副本时调用 materialize()。
+    ImageView view(int x, int y, int w, int h) const throw(int);
+
+    // 调整大小；parallel 为 true 时按行并行（需 OpenMP）
+    Image resizeImage(int new_w, int new_h, ResizeFilter filter = Resize_Nearest, bool parallel = false) const {
+#ifndef _OPENMP
+        (void)parallel;
+#endif
+        if (new_w <= 0 || new_h <= 0) return Image(0, 0);
         Image res(new_h, new_w);
-        double scaleY = (double)getRows() / new_h;
-        double scaleX = (double)getCols() / new_w;
+        int inRows = getRows();
+        int inCols = getCols();
+        if (inRows == 0 || inCols == 0) return res;
 
-        for (int i = 0; i < new_h; ++i) {
+        if (filter == Resize_Nearest) {
+            double scaleY = (double)inRows / new_h;
+            double scaleX = (double)inCols / new_w;
+            Vector<int> srcX(new_w);
             for (int j = 0; j < new_w; ++j) {
+                int x = (int)(j * scaleX);
+                srcX[j] = x >= inCols ? inCols - 1 : x;
+            }
+            const int* xs = &srcX[0];
+#ifdef _OPENMP
+#pragma omp parallel for if(parallel)
+#endif
+            for (int i = 0; i < new_h; ++i) {
                 int srcY = (int)(i * scaleY);
-                int srcX = (int)(j * scaleX);
-                if (srcY >= getRows()) srcY = getRows() - 1;
-                if (srcX >= getCols()) srcX = getCols() - 1;
-                res.setElement(i, j, getElement(srcY, srcX));
+                if (srcY >= inRows) srcY = inRows - 1;
+                const double* src = rowPtr(srcY);
+                double* dst = res.rowPtr(i);
+                for (int j = 0; j < new_w; ++j) {
+                    dst[j] = src[xs[j]];
+                }
+            }
+            return res;
+        }
+
+        ResampleTable colTable, rowTable;
+        buildResampleTable(inCols, new_w, filter, colTable);
+        buildResampleTable(inRows, new_h, filter, rowTable);
+
+        // Horizontal pass over the source rows the vertical table actually touches
+        Vector<int> needed(inRows);
+        for (int i = 0; i < new_h; ++i) {
+            const double* w = &rowTable.weights[(i / 2) * 2 * rowTable.taps + (i % 2)];
+            for (int k = 0; k < rowTable.taps; ++k) {
+                if (w[2 * k] != 0.0) needed[rowTable.start[i] + k] = 1;
+            }
+        }
+        Image temp(inRows, new_w);
+#ifdef _OPENMP
+#pragma omp parallel for if(parallel)
+#endif
+        for (int y = 0; y < inRows; ++y) {
+            if (needed[y]) {
+                resampleRow(rowPtr(y), colTable, new_w, temp.rowPtr(y));
+            }
+        }
+
+        // Vertical pass: weighted sum of whole intermediate rows
+#ifdef _OPENMP
+#pragma omp parallel for if(parallel)
+#endif
+        for (int i = 0; i < new_h; ++i) {
+            double* dst = res.rowPtr(i);
+            const double* w = &rowTable.weights[(i / 2) * 2 * rowTable.taps + (i % 2)];
+            for (int k = 0; k < rowTable.taps; ++k) {
+                if (w[2 * k] != 0.0) {
+                    accumulateRow(temp.rowPtr(rowTable.start[i] + k), w[2 * k], new_w, dst);
+                }
             }
         }
         return res;
     }
 
-    // 归一化 (0-255)
-    void normalize() {
-        if (getRows() == 0 || getCols() == 0) return;
-        
-        double minVal = getElement(0, 0);
-        double maxVal = minVal;
+    // 单趟求最小/最大值（SSE2 + OpenMP 按行归约），返回原始像素值的范围
+    void findMinMax(double& minVal, double& maxVal) const {
+        minVal = maxVal = 0.0;
+        int h = getRows();
+        int w = getCols();
+        if (h == 0 || w == 0) return;
+        minVal = maxVal = rowPtr(0)[0];
 
-        for (int i = 0; i < getRows(); ++i) {
-            for (int j = 0; j < getCols(); ++j) {
-                double val = getElement(i, j);
-                if (val < minVal) minVal = val;
-                if (val > maxVal) maxVal = val;
+#ifdef _OPENMP
+#pragma omp parallel if((long)h * w >= kParallelPixels)
+#endif
+        {
+            double localMin = minVal;
+            double localMax = maxVal;
+#ifdef _OPENMP
+#pragma omp for nowait
+#endif
+            for (int i = 0; i < h; ++i) {
+                const double* row = rowPtr(i);
+                int j = 0;
+#ifdef __SSE2__
+                __m128d vmin = _mm_set1_pd(localMin);
+                __m128d vmax = _mm_set1_pd(localMax);
+                for (; j + 2 <= w; j += 2) {
+                    __m128d v = _mm_loadu_pd(row + j);
+                    vmin = _mm_min_pd(vmin, v);
+                    vmax = _mm_max_pd(vmax, v);
+                }
+                double lanes[2];
+                _mm_storeu_pd(lanes, vmin);
+                localMin = lanes[0] < lanes[1] ? lanes[0] : lanes[1];
+                _mm_storeu_pd(lanes, vmax);
+                localMax = lanes[0] > lanes[1] ? lanes[0] : lanes[1];
+#endif
+                for (; j < w; ++j) {
+                    if (row[j] < localMin) localMin = row[j];
+                    if (row[j] > localMax) localMax = row[j];
+                }
+            }
+#ifdef _OPENMP
+#pragma omp critical(image_minmax)
+#endif
+            {
+                if (localMin < minVal) minVal = localMin;
+                if (localMax > maxVal) maxVal = localMax;
             }
         }
+    }
 
+    // 归一化 (0-255)：单趟求取值范围后原地改写像素
+    void normalize() {
+        double minVal, maxVal;
+        findMinMax(minVal, maxVal);
         if (maxVal - minVal < 1e-6) return;
+        int h = getRows();
+        int w = getCols();
+        double range = maxVal - minVal;
+#ifdef _OPENMP
+#pragma omp parallel for if((long)h * w >= kParallelPixels)
+#endif
+        for (int i = 0; i < h; ++i) {
+            normalizeRow(rowPtr(i), rowPtr(i), w, minVal, range);
+        }
+    }
+
+    // 延迟归一化：求取值范围，返回带有该映射的整幅视图，本图像的像素不变。
+    // 映射在下一处理阶段（Convolution::apply 等接受视图的接口）、savePGM 或 materialize() 中完成，
+    // 省去整幅改写的一趟。视图引用本图像，规则同 view()
+    ImageView normalizedView() const;
+};
+
+// 非拥有的图像视图：引用某幅 Image 中的矩形区域，不复制像素。
+// Image 的每一行是独立的连续存储，因此视图以源图像的行表代替固定步长，
+// 行 r 的首地址为 source->rowPtr(y0 + r) + x0。源图像改变尺寸或被销毁后视图失效。
+// 也可以引用外部的连续缓冲区（如 ImagePyramid 的各层），此时行首为 data + (y0 + r) * rowStride + x0。
+// 视图可以带有待应用的归一化（见 Image::normalizedView）：rowPtr 仍返回源图像的原始值，
+// 读取像素的处理阶段按 hasPendingNormalization() 用 normalizedValue() 换算。
+class ImageView {
+private:
+    const Image* source;
+    const double* data;         // source 为 NULL 时引用的外部缓冲区
+    int rowStride;
+    int x0, y0;
+    int width, height;
+
+    // 延迟归一化：(v - normMin) / normRange * 255
+    bool normPending;
+    double normMin;
+    double normRange;
+
+    friend class Image;
+
+public:
+    ImageView()
+        : source(NULL), data(NULL), rowStride(0), x0(0), y0(0), width(0), height(0), normPending(false),
+          normMin(0.0), normRange(1.0) {}
+
+    // 整幅图像的视图（允许隐式转换，接受视图的接口因此也直接接受 Image）
+    ImageView(const Image& img)
+        : source(&img), data(NULL), rowStride(0), x0(0), y0(0), width(img.getCols()), height(img.getRows()),
+          normPending(false), normMin(0.0), normRange(1.0) {}
+
+    // 图像中的矩形区域；起点越界时抛出 -1，超出右/下边界的部分被截去
+    ImageView(const Image& img, int x, int y, int w, int h) throw(int)
+        : source(&img), data(NULL), rowStride(0), x0(x), y0(y), width(w), height(h), normPending(false),
+          normMin(0.0), normRange(1.0) {
+        if (x < 0 || y < 0 || x > img.getCols() || y > img.getRows()) throw -1;
+        if (width > img.getCols() - x) width = img.getCols() - x;
+        if (height > img.getRows() - y) height = img.getRows() - y;
+        if (width <= 0 || height <= 0) width = height = 0;
+    }
+
+    // 外部缓冲区 pixels 上 rows x cols 的视图，相邻两行相距 stride 个元素；stride < cols 时抛出 -1。
+    // 缓冲区须在视图的生存期内有效
+    ImageView(const double* pixels, int rows, int cols, int stride) throw(int)
+        : source(NULL), data(pixels), rowStride(stride), x0(0), y0(0), width(cols), height(rows),
+          normPending(false), normMin(0.0), normRange(1.0) {
+        if (rows < 0 || cols < 0 || stride < cols) throw -1;
+        if (width == 0 || height == 0) width = height = 0;
+    }
+
+    int getRows() const { return height; }
+    int getCols() const { return width; }
+
+    // 行首指针（无越界检查）
+    const double* rowPtr(int r) const {
+        return source != NULL ? source->rowPtr(y0 + r) + x0 : data + (long)(y0 + r) * rowStride + x0;
+    }
+
+    double getElement(int r, int c) const throw(int) {
+        if (r < 0 || r >= height || c < 0 || c >= width) throw -1;
+        return rowPtr(r)[c];
+    }
+
+    // 视图中的子区域（坐标相对于本视图，沿用本视图待应用的归一化）
+    ImageView crop(int x, int y, int w, int h) const throw(int) {
+        if (x < 0 || y < 0 || x > width || y > height) throw -1;
+        if (w > width - x) w = width - x;
+        if (h > height - y) h = height - y;
+        if (w <= 0 || h <= 0) return ImageView();
+        ImageView res(*this);
+        res.x0 += x;
+        res.y0 += y;
+        res.width = w;
+        res.height = h;
+        return res;
+    }
+
+    bool hasPendingNormalization() const { return normPending; }
+
+    // 对单个原始值应用待定的归一化映射
+    double normalizedValue(double raw) const { return (raw - normMin) / normRange * 255.0; }
+
+    // 复制出独立的图像（待应用的归一化在复制时完成）
+    Image materialize() const {
+        Image res(height, width);
+#ifdef _OPENMP
+#pragma omp parallel for if(normPending && (long)height * width >= kParallelPixels)
+#endif
+        for (int i = 0; i < height; ++i) {
+            const double* src = rowPtr(i);
+            double* dst = res.rowPtr(i);
+            if (normPending) {
+                normalizeRow(src, dst, width, normMin, normRange);
+            } else {
+                for (int j = 0; j < width; ++j) {
+                    dst[j] = src[j];
+                }
+            }
+        }
+        return res;
+    }
+
+    // 保存 PGM (P2)
+    bool savePGM(const string& filename) const {
+        ofstream file(filename.c_str());
+        if (!file) return false;
 
+        file << "P2" << endl;
+        file << getCols() << " " << getRows() << endl;
+        file << "255" << endl;
+
+        bool lazy = hasPendingNormalization();
         for (int i = 0; i < getRows(); ++i) {
+            const double* row = rowPtr(i);
             for (int j = 0; j < getCols(); ++j) {
-                double val = getElement(i, j);
-                setElement(i, j, (val - minVal) / (maxVal - minVal) * 255.0);
+                double val = lazy ? normalizedValue(row[j]) : row[j];
+                int pixel = (int)val;
+                if (pixel < 0) pixel = 0;
+                if (pixel > 255) pixel = 255;
+                file << pixel << (j == getCols() - 1 ? "" : " ");
             }
+            file << endl;
         }
+        return true;
     }
 };
 
+inline Image::Image(const ImageView& view) : Matrix(0, 0) {
+    *this = view.materialize();
+}
+
+inline bool Image::savePGM(const string& filename) const {
+    return ImageView(*this).savePGM(filename);
+}
+
+inline ImageView Image::view(int x, int y, int w, int h) const throw(int) {
+    return ImageView(*this, x, y, w, h);
+}
+
+inline ImageView Image::normalizedView() const {
+    ImageView res(*this);
+    double minVal, maxVal;
+    findMinMax(minVal, maxVal);
+    if (maxVal - minVal >= 1e-6) {
+        res.normPending = true;
+        res.normMin = minVal;
+        res.normRange = maxVal - minVal;
+    }
+    return res;
+}
+
 #endif
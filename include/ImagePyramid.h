@@ -0,0 +1,51 @@
+#ifndef IMAGEPYRAMID_H
+#define IMAGEPYRAMID_H
+
+#include "Image.h"
+#include "Convolution.h"
+#include "SobelDetector.h"
+
+// 高斯金字塔：每层由上一层做可分离高斯模糊并 2 倍降采样得到。
+// 模糊与降采样在同一趟中完成，只计算保留下来的采样点；
+// 所有层连续存放在同一块内存中（第 0 层为原图）。
+class ImagePyramid {
+private:
+    Vector<double> storage;     // 各层像素，按层依次连续存放
+    Vector<int> offsets;        // 每层在 storage 中的起始位置
+    Vector<int> levelRows;
+    Vector<int> levelCols;
+    int levels;                 // 实际构建出的层数
+
+    int requestedLevels;
+    Vector<double> taps;        // 一维高斯核（已归一化）
+    Convolution::PaddingMode paddingMode;
+
+    void downsample(const double* src, int inRows, int inCols,
+                    double* dst, int outRows, int outCols, double* temp) const;
+
+public:
+    ImagePyramid(int levelCount = 4, int kernelSize = 5, double sigma = 1.0);
+
+    void setPadding(Convolution::PaddingMode p);
+
+    // 由输入图像构建金字塔（层尺寸过小时提前停止）
+    void build(const ImageView& input);
+
+    int getLevelCount() const { return levels; }
+    int getLevelRows(int level) const throw(int);
+    int getLevelCols(int level) const throw(int);
+
+    // 指向某层像素的指针（行优先、行间无间隙）
+    const double* levelData(int level) const throw(int);
+
+    // 复制出某层图像
+    Image getLevel(int level) const throw(int);
+
+    // 某层的视图（不复制，直接引用金字塔的存储；重新 build 后失效）
+    ImageView levelView(int level) const throw(int);
+
+    // 在指定层上做 Sobel 边缘检测（由粗到细检测时从最高层开始调用；直接读取该层的存储）
+    Image detectEdges(int level, const SobelDetector& sobel) const throw(int);
+};
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef KERNELPLAN_H
+#define KERNELPLAN_H
+
+#include "Matrix.h"
+
+// 预编译的卷积核：在 setKernel 时分析一次，之后每次 apply 直接使用。
+// 保存行优先展平的抽头、非零抽头列表、按 |权重| 的分组（镜像对称/反对称的抽头对落在同一组）与可分离性分析结果，以及选定的执行策略。
+class KernelPlan {
+public:
+    enum Strategy {
+        Strategy_Direct,        // 逐个抽头累加
+        Strategy_Separable,     // 先行后列两趟一维卷积
+        Strategy_FixedSize,     // 3x3 / 5x5 / 7x7 的编译期展开版本（仅步长 1；其他步长下可分离核走 Separable，否则退回 Direct）
+        Strategy_Sparse         // 跳过零抽头，按 |权重| 分组：先对同组像素做加减，再每组乘一次
+    };
+
+private:
+    int rows;
+    int cols;
+    Vector<double> taps;        // rows * cols，行优先
+
+    // 非零抽头
+    Vector<int> nonzeroRows;
+    Vector<int> nonzeroCols;
+    Vector<double> nonzeroWeights;
+
+    // 按绝对值相同的非零权重分组；第 g 组成员为 [groupStart[g], groupStart[g+1])，
+    // 贡献为 groupWeights[g] * sum(memberSigns[t] * pixel(memberRows[t], memberCols[t]))
+    Vector<double> groupWeights;
+    Vector<int> groupStart;
+    Vector<int> memberRows;
+    Vector<int> memberCols;
+    Vector<int> memberSigns;
+
+    // 可分离时 kernel(m, n) == columnFilter[m] * rowFilter[n]
+    bool separable;
+    Vector<double> rowFilter;
+    Vector<double> columnFilter;
+
+    Strategy strategy;
+
+    void detectSeparable();
+    void buildGroups();
+
+public:
+    KernelPlan();
+    explicit KernelPlan(const Matrix& kernel);
+
+    // 分析卷积核并选择执行策略
+    void compile(const Matrix& kernel);
+
+    int getRows() const { return rows; }
+    int getCols() const { return cols; }
+    const double* tapData() const { return taps.getsize() > 0 ? &taps[0] : NULL; }
+
+    int getNonzeroCount() const { return nonzeroWeights.getsize(); }
+    const Vector<int>& getNonzeroRows() const { return nonzeroRows; }
+    const Vector<int>& getNonzeroCols() const { return nonzeroCols; }
+    const Vector<double>& getNonzeroWeights() const { return nonzeroWeights; }
+
+    // 不同的非零 |权重| 个数，即 Sparse 策略每像素的乘法次数
+    int getGroupCount() const { return groupWeights.getsize(); }
+    const Vector<double>& getGroupWeights() const { return groupWeights; }
+    const Vector<int>& getGroupStart() const { return groupStart; }
+    const Vector<int>& getMemberRows() const { return memberRows; }
+    const Vector<int>& getMemberCols() const { return memberCols; }
+    const Vector<int>& getMemberSigns() const { return memberSigns; }
+
+    bool isSeparable() const { return separable; }
+    const Vector<double>& getRowFilter() const { return rowFilter; }
+    const Vector<double>& getColumnFilter() const { return columnFilter; }
+
+    Strategy getStrategy() const { return strategy; }
+
+    // 该策略能否按原意执行（FixedSize 需要 3/5/7 方核且步长为 1，Separable 需要可分离）；
+    // 不能时 Convolution::execute 会退回其他路径，结果不变
+    bool supports(Strategy s, int stride) const;
+
+    // 是否有编译期展开的固定尺寸实现
+    bool hasFixedSize() const { return rows == cols && (rows == 3 || rows == 5 || rows == 7); }
+};
+
+#endif
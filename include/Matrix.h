@@ -52,6 +52,10 @@ public:
         data[r][c] = val;
     }
 
+    // Unchecked row access for hot loops (each row is contiguous)
+    double* rowPtr(int r) { return &data[r][0]; }
+    const double* rowPtr(int r) const { return &data[r][0]; }
+
     void Output(ostream& out) const {
         for (int i = 0; i < rows; ++i) {
             out << data[i] << endl;
@@ -108,16 +112,43 @@ public:
     Matrix operator*(const Matrix& other) const throw(double) {
         if (cols != other.rows) throw -1.0;
         Matrix result(rows, other.cols);
-        for (int i = 0; i < rows; ++i) {
+        multiplyInto(other, result);
+        return result;
+    }
+
+    // result = this * other，写入已分配好的 result（重复相乘时省去每次分配）；
+    // 维度不匹配时抛出 -1.0
+    // Blocked i-k-j order: the inner loop walks rows of 'other' and 'result'
+    // contiguously, and each k-block of 'other' stays in cache across all i.
+    // Every element still sums its k terms in ascending order.
+    void multiplyInto(const Matrix& other, Matrix& result) const throw(double) {
+        if (cols != other.rows || result.rows != rows || result.cols != other.cols) throw -1.0;
+        for (int i = 0; i < rows && other.cols > 0; ++i) {
+            double* c = result.rowPtr(i);
             for (int j = 0; j < other.cols; ++j) {
-                double sum = 0;
-                for (int k = 0; k < cols; ++k) {
-                    sum += data[i][k] * other.data[k][j];
+                c[j] = 0.0;
+            }
+        }
+        if (rows == 0 || cols == 0 || other.cols == 0) return;
+
+        const int block = 64;
+        for (int kb = 0; kb < cols; kb += block) {
+            int kEnd = kb + block < cols ? kb + block : cols;
+            for (int jb = 0; jb < other.cols; jb += block) {
+                int jEnd = jb + block < other.cols ? jb + block : other.cols;
+                for (int i = 0; i < rows; ++i) {
+                    const double* a = rowPtr(i);
+                    double* c = result.rowPtr(i);
+                    for (int k = kb; k < kEnd; ++k) {
+                        double aik = a[k];
+                        const double* b = other.rowPtr(k);
+                        for (int j = jb; j < jEnd; ++j) {
+                            c[j] += aik * b[j];
+                        }
+                    }
                 }
-                result.setElement(i, j, sum);
             }
         }
-        return result;
     }
 
     Matrix transpose() const {
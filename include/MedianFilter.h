@@ -0,0 +1,29 @@
+#ifndef MEDIANFILTER_H
+#define MEDIANFILTER_H
+
+#include "Convolution.h"
+
+// 中值滤波（去除椒盐噪声，通常放在 SobelDetector 之前）。填充方式与步长沿用 Convolution。
+// 8 位输入且 stride == 1 时：3x3 按列排序后合并，5x5 用剪枝的排序网络（SSE2 一次处理 16 个像素），
+// 其他窗口用 Perreault–Hébert 直方图算法，每像素代价与窗口大小无关；
+// 其余情况逐像素 nth_element 选择。
+class MedianFilter : public Convolution {
+private:
+    int windowSize;
+
+    Image apply8Bit(const Vector<unsigned char>& pixels, int paddedRows, int paddedCols) const;
+    Image applyGeneric(const ImageView& input) const;
+
+public:
+    // size: 窗口边长（偶数时取较低的中值）；size 不在 1-255 范围内时抛出 -1
+    explicit MedianFilter(int size = 3) throw(int);
+
+    void setSize(int size) throw(int);
+    int getSize() const { return windowSize; }
+
+    using Convolution::apply;
+    virtual Image apply(const ImageView& input) const;
+    virtual int getRadius() const { return windowSize / 2; }
+};
+
+#endif
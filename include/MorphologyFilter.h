@@ -0,0 +1,40 @@
+#ifndef MORPHOLOGYFILTER_H
+#define MORPHOLOGYFILTER_H
+
+#include "Convolution.h"
+
+// 灰度形态学（腐蚀/膨胀/开/闭运算），用于清理 SobelDetector 阈值化后的边缘图。
+// 矩形结构元素分解为先纵向、后横向的两趟一维 min/max，每趟用 van Herk / Gil-Werman
+// 算法，每像素代价与窗口大小无关。8 位输入（含 0/255 二值图）与一般 double 输入各有
+// SSE2 纵向路径。填充方式与步长沿用 Convolution；Padding_Replicate 等价于把窗口裁剪到图像内。
+class MorphologyFilter : public Convolution {
+public:
+    enum Operation {
+        Operation_Erode,    // 窗口内最小值
+        Operation_Dilate,   // 窗口内最大值
+        Operation_Open,     // 先腐蚀后膨胀：去除小于结构元素的亮点
+        Operation_Close     // 先膨胀后腐蚀：填补小于结构元素的暗缝
+    };
+
+private:
+    Operation operation;
+    int elementWidth;
+    int elementHeight;
+
+    // 单次腐蚀或膨胀（stride 为 1）
+    Image applyOnce(const ImageView& input, bool erode) const;
+
+public:
+    // width/height: 矩形结构元素的宽和高；小于 1 时抛出 -1
+    explicit MorphologyFilter(Operation op = Operation_Dilate, int width = 3, int height = 3) throw(int);
+
+    void setOperation(Operation op);
+    void setElementSize(int width, int height) throw(int);
+
+    using Convolution::apply;
+    virtual Image apply(const ImageView& input) const;
+    // 开/闭运算是两次窗口运算，半径加倍
+    virtual int getRadius() const;
+};
+
+#endif
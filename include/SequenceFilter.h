@@ -0,0 +1,46 @@
+#ifndef SEQUENCEFILTER_H
+#define SEQUENCEFILTER_H
+
+#include "Convolution.h"
+
+// 图像序列的增量滤波（如摄像头流上的 SobelDetector）：每帧按块与上一帧比较，
+// 只对变化的块及其外扩 getRadius() 的区域重新滤波，其余位置沿用上一帧的输出。
+// 画面大部分静止时，每帧代价与变化面积成正比。
+// 以下情况整帧重算：第一帧、帧尺寸改变、滤波器对该帧不是局部的（isLocal(frame) 为 false，如自动阈值）、
+// 步长不为 1 或输出与输入尺寸不同（Padding_None）、变化块超过一半。
+// 滤波器的参数改变后须调用 reset()。
+class SequenceFilter {
+private:
+    const Convolution* filter;
+    int tileSize;
+
+    Image previous;             // 上一帧（已应用待定的归一化）
+    Image output;               // 上一帧的滤波结果
+    bool primed;
+
+    int changedTiles;           // 最近一帧中变化的块数
+    int tileCount;
+
+    // 比较并把变化的块写入 previous；dirty 按块行优先标记，返回变化块数
+    int diffFrame(const ImageView& frame, int tilesX, Vector<unsigned char>& dirty);
+    void recomputeRegion(int x, int y, int w, int h);
+    void recomputeAll();
+
+public:
+    // filter 在本对象的生存期内必须有效；tileSize 小于 1 时抛出 -1
+    explicit SequenceFilter(const Convolution& f, int tileSize = 64) throw(int);
+
+    void setTileSize(int size) throw(int);
+    int getTileSize() const { return tileSize; }
+
+    // 丢弃缓存的上一帧，下一帧整帧重算
+    void reset();
+
+    // 处理下一帧；返回的引用在下次调用 process 或 reset 之前有效
+    const Image& process(const ImageView& frame);
+
+    int getChangedTiles() const { return changedTiles; }
+    int getTileCount() const { return tileCount; }
+};
+
+#endif
@@ -2,12 +2,40 @@
 #define SOBELDETECTOR_H
 
 #include "Convolution.h"
+#include "FilterBank.h"
+#include "BitMask.h"
 
 class SobelDetector : public Convolution {
+public:
+    // 梯度幅值的计算方式
+    enum MagnitudeMode {
+        Magnitude_L2,   // sqrt(Gx^2 + Gy^2)，精确值；阈值模式下直接比较平方，无需开方
+        Magnitude_L1,   // |Gx| + |Gy|，近似值，适合实时预览
+        Magnitude_Max   // max(|Gx|, |Gy|)，最快的近似
+    };
+
 private:
     bool useThreshold;
+    bool useAutoThreshold;
     double thresholdValue;
     bool invertOutput;
+    bool useFixedPoint;
+    MagnitudeMode magnitudeMode;
+
+    // Gx、Gy 两个 Sobel 核组成的滤波器组（进程内只构建一次，一次遍历得到两个梯度平面）
+    static const FilterBank& gradientBank();
+
+    // 8 位整数路径（输入像素均为 0-255 整数时可用）
+    Image applyFixedPoint(const Vector<unsigned char>& pixels, int inRows, int inCols, double* usedThreshold) const;
+
+    // 自动阈值：幅值遍历时顺带统计直方图（每线程私有分桶，结束时合并），Otsu 选出阈值后二值化
+    Image autoThresholdFixedPoint(const Vector<unsigned char>& pixels, int rows, int cols, int pw,
+                                  double* usedThreshold) const;
+    // 非 8 位输入：直方图的桶宽为 2 的幂，在幅值遍历中按需加倍，不需要事先求取值范围
+    Image autoThreshold(const Image& gx, const Image& gy, double* usedThreshold) const;
+
+    // 固定阈值的 8 位路径直接输出位掩码（比较结果用 movemask 打包，不经过 Image）
+    BitMask packFixedPoint(const Vector<unsigned char>& pixels, int inRows, int inCols) const;
 
 public:
     SobelDetector();
@@ -15,14 +43,38 @@ public:
     // 设置阈值（启用阈值处理）
     void setThreshold(double t);
     
-    // 禁用阈值处理
+    // 启用自动阈值（Otsu 法，按每幅图像的梯度幅值直方图选取）；之后 setThreshold 会改回固定阈值
+    void setAutoThreshold();
+
+    // 禁用阈值处理（固定阈值与自动阈值）
     void disableThreshold();
 
     // 设置是否反转输出（true=白底黑边，false=黑底白边）
     void setInvert(bool inv);
 
+    // 启用 8 位定点路径：梯度幅值直接量化为 0-255 整数，与 savePGM 的截断结果逐位一致。
+    // 阈值模式下输出本就只有 0/255，对 8 位输入总是走整数路径。
+    void setFixedPoint(bool enable);
+
+    // 设置梯度幅值的计算方式（默认 Magnitude_L2）
+    void setMagnitudeMode(MagnitudeMode mode);
+
+    using Convolution::apply;
+
     // 重写 apply 方法
-    virtual Image apply(const Image& input) const;
+    virtual Image apply(const ImageView& input) const;
+
+    // 3x3 梯度核。自动阈值依赖整幅图像的直方图；定点幅值（无阈值）只在整幅输入为 8 位时
+    // 走饱和的整数路径，否则各区域可能选到不同路径，因此这两种情况都不是局部的
+    virtual int getRadius() const { return 1; }
+    virtual bool isLocal(const ImageView& input) const;
+
+    // 同上，并通过 usedThreshold 返回实际使用的阈值（自动阈值模式下为 Otsu 选出的值，
+    // 固定阈值时为 setThreshold 的值，未启用阈值时为 -1）
+    Image apply(const ImageView& input, double* usedThreshold) const;
+
+    // 阈值化结果保存为位掩码（置位 = 输出 255）；未启用阈值（固定或自动）时抛出 -1
+    BitMask applyMask(const ImageView& input, double* usedThreshold = 0) const throw(int);
 };
 
 #endif
@@ -0,0 +1,72 @@
+#ifndef TILEDIMAGE_H
+#define TILEDIMAGE_H
+
+#include "Convolution.h"
+#include <stdint.h>
+#include <fstream>
+#include <string>
+
+// 分块存储的 8 位灰度图像文件，用于超大图像（如十亿像素扫描）的局部读取。
+// 文件布局（整数均为小端）：
+//   0   "MCTI"，版本号 u32，宽 u32，高 u32，块宽 u32，块高 u32，标志 u32（bit0 = 含校验和），保留 u32
+//   32  块索引：按块行优先，每块 { 偏移 u64, 字节数 u32, Adler-32 校验和 u32 }
+//   之后为各块像素（块内行优先，右/下边缘的块按实际大小存放）
+// 读取某个区域时只读取与之相交的块，I/O 量与区域大小成正比，而不是与整幅图像成正比。
+class TiledImage {
+private:
+    ifstream file;
+    int width;
+    int height;
+    int tileWidth;
+    int tileHeight;
+    int tilesX;
+    int tilesY;
+    bool hasChecksums;
+    Vector<uint64_t> tileOffsets;
+    Vector<unsigned int> tileSizes;
+    Vector<unsigned int> tileChecksums;
+
+    // 读取区域 [x, x+w) x [y, y+h) 的像素到 out（行优先，w*h 字节）；I/O 错误或校验和不符时返回 false
+    bool readBytes(int x, int y, int w, int h, Vector<unsigned char>& out);
+
+    // 不可复制（持有打开的文件）
+    TiledImage(const TiledImage&);
+    TiledImage& operator=(const TiledImage&);
+
+public:
+    TiledImage();
+
+    // 读取文件头与块索引；格式不符、或文件头声明的块索引与块大小超出文件长度时返回 false
+    bool open(const string& filename);
+    void close();
+    bool isOpen() const { return file.is_open(); }
+
+    int getRows() const { return height; }
+    int getCols() const { return width; }
+    int getTileWidth() const { return tileWidth; }
+    int getTileHeight() const { return tileHeight; }
+
+    // 读取区域 (x, y, w, h)，规则与 ImageView 相同：起点越界时抛出 -1，超出右/下边界的部分被截去。
+    // I/O 错误或校验和不符时返回 false
+    bool readRegion(int x, int y, int w, int h, Image& out) throw(int);
+
+    // 读取区域并向四周外扩 halo 个像素（在图像边界处截止）；roiX/roiY 返回原区域在 out 中的起点
+    bool readRegion(int x, int y, int w, int h, int halo, Image& out, int& roiX, int& roiY) throw(int);
+
+    // 只读取区域加上滤波器半径的外扩部分并滤波，结果与对整幅图像滤波后再裁剪出该区域一致。
+    // 滤波器须是局部的、步长为 1 且有填充（输出与输入同尺寸），否则抛出 -1
+    bool applyToRegion(const Convolution& filter, int x, int y, int w, int h, Image& out) throw(int);
+
+    // 写出分块文件；像素按 savePGM 的规则量化（截断并钳位到 0-255，先应用待定的归一化）。
+    // 块宽、块高小于 1 时抛出 -1
+    static bool save(const ImageView& image, const string& filename, int tileW = 256, int tileH = 256,
+                     bool checksums = true) throw(int);
+
+    // PGM (P2/P5, 1 <= maxVal <= 255) 与分块文件互转。两者都按块行流式处理，内存中只保留一个块行
+    static bool fromPGM(const string& pgmFile, const string& tiledFile, int tileW = 256, int tileH = 256,
+                        bool checksums = true) throw(int);
+    // 输出为二进制 P5
+    static bool toPGM(const string& tiledFile, const string& pgmFile);
+};
+
+#endif
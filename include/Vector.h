@@ -6,6 +6,20 @@
 
 #include "Vec.h"
 
+// 一维卷积/相关的输出范围（与 numpy.convolve 的三种模式一致）
+enum ConvolveMode {
+	Convolve_Full,	// 全部 n+m-1 个输出
+	Convolve_Same,	// 与较长的输入等长，取全卷积的中间部分
+	Convolve_Valid	// 只保留两者完全重叠的部分（长度 max-min+1）
+};
+
+// 计算全卷积 out[k] = sum_j a[first+k-j] * b[j] 中 k = 0..count-1 的部分，不分配临时对象。
+// double 有专门实现（SIMD 直接法 / FFT 自动选择，见 VectorConvolution.cpp）
+template <typename T>
+void convolveRange(const T *a, int n, const T *b, int m, int first, int count, T *out);
+
+template <> void convolveRange<double>(const double *a, int n, const double *b, int m, int first, int count, double *out);
+
 template <typename T> class Vector : public VECTOR<T>
 {
 public:
@@ -26,6 +40,8 @@ public:
 	Vector<T> reverse() const; // 反转向量元素顺序
 	Vector<T> subvector(int start, int length) const throw(double); // 提取子向量
 	Vector<T> pad(int padding, T value) const; // 在向量两端添加填充
+	Vector<T> convolve(const Vector<T> &kernel, ConvolveMode mode = Convolve_Full) const; // 一维卷积
+	Vector<T> correlate(const Vector<T> &kernel, ConvolveMode mode = Convolve_Full) const; // 一维相关（核不翻转）
 };
 
 template <typename T>
@@ -187,4 +203,51 @@ Vector<T> Vector<T>::pad(int padding, T value) const {
     return result;
 }
 
-#endif
\ No newline at end of file
+template <typename T>
+void convolveRange(const T *a, int n, const T *b, int m, int first, int count, T *out) {
+    // Convolution commutes; keep the shorter input as the kernel
+    if (m > n) {
+        const T *t = a; a = b; b = t;
+        int len = n; n = m; m = len;
+    }
+    for (int k = 0; k < count; ++k) {
+        int f = first + k;
+        int lo = (f - n + 1 > 0) ? f - n + 1 : 0;
+        int hi = (f < m - 1) ? f : m - 1;
+        T sum = 0;
+        for (int j = lo; j <= hi; ++j) {
+            sum += a[f - j] * b[j];
+        }
+        out[k] = sum;
+    }
+}
+
+template <typename T>
+Vector<T> Vector<T>::convolve(const Vector<T> &kernel, ConvolveMode mode) const {
+    int n = this->num;
+    int m = kernel.num;
+    if (n == 0 || m == 0) {
+        return Vector<T>();
+    }
+    int shorter = (n < m) ? n : m;
+    int longer = (n < m) ? m : n;
+    int first = 0;
+    int count = n + m - 1;
+    if (mode == Convolve_Same) {
+        first = (shorter - 1) / 2;
+        count = longer;
+    } else if (mode == Convolve_Valid) {
+        first = shorter - 1;
+        count = longer - shorter + 1;
+    }
+    Vector<T> result(count);
+    convolveRange(this->p, n, kernel.p, m, first, count, result.p);
+    return result;
+}
+
+template <typename T>
+Vector<T> Vector<T>::correlate(const Vector<T> &kernel, ConvolveMode mode) const {
+    return convolve(kernel.reverse(), mode);
+}
+
+#endif
@@ -0,0 +1,257 @@
+#include "Autotuner.h"
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <typeinfo>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+static const KernelPlan::Strategy kCandidates[] = {
+    KernelPlan::Strategy_Direct,
+    KernelPlan::Strategy_Separable,
+    KernelPlan::Strategy_FixedSize,
+    KernelPlan::Strategy_Sparse
+};
+static const int kCandidateCount = sizeof(kCandidates) / sizeof(kCandidates[0]);
+
+// Wall-clock seconds. clock() is CPU time, which would charge the parallel
+// strategies for every thread, so it is only used when OpenMP is off.
+static double now() {
+#ifdef _OPENMP
+    return omp_get_wtime();
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static int threadCount() {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+static long processId() {
+#ifdef _WIN32
+    return (long)_getpid();
+#else
+    return (long)getpid();
+#endif
+}
+
+// Process-wide save counter, incremented atomically so that threads saving at
+// the same time never draw the same number
+static unsigned long nextSaveId() {
+#ifdef _WIN32
+    static volatile LONG count = 0;
+    return (unsigned long)InterlockedIncrement(&count);
+#else
+    static unsigned long count = 0;
+    return __sync_add_and_fetch(&count, 1UL);
+#endif
+}
+
+// rename() does not replace an existing file on Windows
+static bool replaceFile(const string& from, const string& to) {
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+Autotuner::Autotuner() : repetitions(2), forced(false), forcedStrategy(KernelPlan::Strategy_Direct) {}
+
+Autotuner::Autotuner(const string& path)
+    : profilePath(path), repetitions(2), forced(false), forcedStrategy(KernelPlan::Strategy_Direct) {
+    loadProfile(path);
+}
+
+// The winner depends on which strategies the kernel admits and how much they
+// save, so besides the sizes the key carries the non-zero and weight-group
+// counts and separability, plus the thread count the timings were taken with.
+string Autotuner::shapeKey(const KernelPlan& plan, const ImageView& input, int stride,
+                           Convolution::PaddingMode padding) {
+    ostringstream key;
+    key << "k" << plan.getRows() << "x" << plan.getCols()
+        << ",nz" << plan.getNonzeroCount()
+        << ",g" << plan.getGroupCount()
+        << ",sep" << (plan.isSeparable() ? 1 : 0)
+        << ",s" << stride
+        << ",p" << (int)padding
+        << ",img" << input.getRows() << "x" << input.getCols()
+        << ",t" << threadCount();
+    return key.str();
+}
+
+int Autotuner::find(const string& key) const {
+    for (int i = 0; i < keys.getsize(); ++i) {
+        if (keys[i] == key) return i;
+    }
+    return -1;
+}
+
+void Autotuner::record(const string& key, KernelPlan::Strategy strategy, double elapsed) {
+    int i = find(key);
+    if (i < 0) {
+        i = keys.getsize();
+        keys.resize(i + 1);
+        winners.resize(i + 1);
+        seconds.resize(i + 1);
+        keys[i] = key;
+    }
+    winners[i] = (int)strategy;
+    seconds[i] = elapsed;
+}
+
+bool Autotuner::loadProfile(const string& path) {
+    ifstream file(path.c_str());
+    if (!file) return false;
+
+    string line;
+    while (getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        istringstream fields(line);
+        string key, name;
+        double elapsed;
+        if (!(fields >> key >> name >> elapsed)) continue;
+        try {
+            record(key, parseStrategy(name), elapsed);
+        } catch (int) {
+            // Written by a newer version with a strategy this one lacks
+        }
+    }
+    return true;
+}
+
+// The temporary name is unique per process and per save, so concurrent savers
+// (other processes or other threads) never write into the same file; the last
+// replace wins whole
+bool Autotuner::saveProfile(const string& path) const {
+    ostringstream tempName;
+    tempName << path << "." << processId() << "." << nextSaveId() << ".tmp";
+    string temp = tempName.str();
+    {
+        ofstream file(temp.c_str());
+        if (!file) return false;
+        file << "# convolution autotune profile: shape strategy seconds\n";
+        for (int i = 0; i < keys.getsize(); ++i) {
+            file << keys[i] << " " << strategyName((KernelPlan::Strategy)winners[i]) << " "
+                 << seconds[i] << "\n";
+        }
+        file.close();
+        if (file.fail()) {
+            remove(temp.c_str());
+            return false;
+        }
+    }
+    if (!replaceFile(temp, path)) {
+        remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+void Autotuner::setRepetitions(int n) throw(int) {
+    if (n < 1) throw -1;
+    repetitions = n;
+}
+
+void Autotuner::forceStrategy(KernelPlan::Strategy strategy) {
+    forced = true;
+    forcedStrategy = strategy;
+}
+
+void Autotuner::clearForcedStrategy() {
+    forced = false;
+}
+
+KernelPlan::Strategy Autotuner::lookup(const KernelPlan& plan, const ImageView& input, int stride,
+                                       Convolution::PaddingMode padding) const {
+    if (forced) return forcedStrategy;
+    int i = find(shapeKey(plan, input, stride, padding));
+    return i < 0 ? plan.getStrategy() : (KernelPlan::Strategy)winners[i];
+}
+
+// Only a plain Convolution is fully described by its kernel plan; subclasses
+// (Sobel, median, morphology) compute something else in apply
+Image Autotuner::apply(const Convolution& conv, const ImageView& input) {
+    if (typeid(conv) != typeid(Convolution)) {
+        return conv.apply(input);
+    }
+    return apply(conv.getPlan(), input, conv.getStride(), conv.getPadding());
+}
+
+Image Autotuner::apply(const KernelPlan& plan, const ImageView& input, int stride,
+                       Convolution::PaddingMode padding) {
+    if (forced) {
+        return Convolution::execute(plan, forcedStrategy, input, stride, padding);
+    }
+
+    string key = shapeKey(plan, input, stride, padding);
+    int cached = find(key);
+    if (cached >= 0) {
+        return Convolution::execute(plan, (KernelPlan::Strategy)winners[cached], input, stride, padding);
+    }
+
+    // Strategies the plan cannot run as such would only re-time another path
+    Image best;
+    KernelPlan::Strategy bestStrategy = plan.getStrategy();
+    double bestTime = -1.0;
+    for (int c = 0; c < kCandidateCount; ++c) {
+        KernelPlan::Strategy strategy = kCandidates[c];
+        if (!plan.supports(strategy, stride)) continue;
+
+        double fastest = -1.0;
+        Image result;
+        for (int r = 0; r < repetitions; ++r) {
+            double start = now();
+            result = Convolution::execute(plan, strategy, input, stride, padding);
+            double elapsed = now() - start;
+            if (fastest < 0.0 || elapsed < fastest) fastest = elapsed;
+        }
+        if (bestTime < 0.0 || fastest < bestTime) {
+            bestTime = fastest;
+            bestStrategy = strategy;
+            best = result;
+        }
+    }
+
+    // Pick up shapes other processes tuned since the profile was read, so the
+    // rewrite does not drop them
+    if (!profilePath.empty()) {
+        loadProfile(profilePath);
+    }
+    record(key, bestStrategy, bestTime);
+    if (!profilePath.empty()) {
+        saveProfile(profilePath);
+    }
+    return best;
+}
+
+const char* Autotuner::strategyName(KernelPlan::Strategy strategy) {
+    switch (strategy) {
+        case KernelPlan::Strategy_Separable: return "separable";
+        case KernelPlan::Strategy_FixedSize: return "fixed";
+        case KernelPlan::Strategy_Sparse: return "sparse";
+        default: return "direct";
+    }
+}
+
+KernelPlan::Strategy Autotuner::parseStrategy(const string& name) throw(int) {
+    for (int c = 0; c < kCandidateCount; ++c) {
+        if (name == strategyName(kCandidates[c])) return kCandidates[c];
+    }
+    throw -1;
+}
@@ -0,0 +1,237 @@
+#include "BitMask.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Bit-reversal of a byte: masks store the leftmost pixel in the lowest bit, PBM in the highest
+static unsigned char reverseBits(unsigned char b) {
+    b = (unsigned char)(((b & 0xF0) >> 4) | ((b & 0x0F) << 4));
+    b = (unsigned char)(((b & 0xCC) >> 2) | ((b & 0x33) << 2));
+    b = (unsigned char)(((b & 0xAA) >> 1) | ((b & 0x55) << 1));
+    return b;
+}
+
+// 64-bit constant from a repeated 32-bit pattern (C++98 has no 64-bit literals)
+static uint64_t repeat32(unsigned long pattern) {
+    return ((uint64_t)pattern << 32) | (uint64_t)pattern;
+}
+
+static int countBits(uint64_t w) {
+    static const uint64_t m1 = repeat32(0x55555555UL);
+    static const uint64_t m2 = repeat32(0x33333333UL);
+    static const uint64_t m4 = repeat32(0x0F0F0F0FUL);
+    static const uint64_t h01 = repeat32(0x01010101UL);
+    w = w - ((w >> 1) & m1);
+    w = (w & m2) + ((w >> 2) & m2);
+    w = (w + (w >> 4)) & m4;
+    return (int)((w * h01) >> 56);
+}
+
+static void skipPBMComments(ifstream& file) {
+    while (true) {
+        file >> ws;
+        if (file.peek() == '#') {
+            file.ignore(65536, '\n');
+        } else {
+            break;
+        }
+    }
+}
+
+BitMask::BitMask(int r, int c) : rows(r), cols(c), wordsPerRow((c + 63) / 64), words(r * ((c + 63) / 64)) {}
+
+uint64_t BitMask::tailMask() const {
+    int used = cols % 64;
+    return used == 0 ? ~(uint64_t)0 : (((uint64_t)1 << used) - 1);
+}
+
+bool BitMask::get(int r, int c) const throw(int) {
+    if (r < 0 || r >= rows || c < 0 || c >= cols) throw -1;
+    return (rowWords(r)[c / 64] >> (c % 64)) & 1;
+}
+
+void BitMask::set(int r, int c, bool value) throw(int) {
+    if (r < 0 || r >= rows || c < 0 || c >= cols) throw -1;
+    uint64_t bit = (uint64_t)1 << (c % 64);
+    uint64_t& w = rowWords(r)[c / 64];
+    w = value ? (w | bit) : (w & ~bit);
+}
+
+BitMask& BitMask::operator&=(const BitMask& other) throw(double) {
+    if (rows != other.rows || cols != other.cols) throw -1.0;
+    int n = rows * wordsPerRow;
+    uint64_t* dst = n ? &words[0] : 0;
+    const uint64_t* src = n ? &other.words[0] : 0;
+    for (int k = 0; k < n; ++k) {
+        dst[k] &= src[k];
+    }
+    return *this;
+}
+
+BitMask& BitMask::operator|=(const BitMask& other) throw(double) {
+    if (rows != other.rows || cols != other.cols) throw -1.0;
+    int n = rows * wordsPerRow;
+    uint64_t* dst = n ? &words[0] : 0;
+    const uint64_t* src = n ? &other.words[0] : 0;
+    for (int k = 0; k < n; ++k) {
+        dst[k] |= src[k];
+    }
+    return *this;
+}
+
+BitMask& BitMask::operator^=(const BitMask& other) throw(double) {
+    if (rows != other.rows || cols != other.cols) throw -1.0;
+    int n = rows * wordsPerRow;
+    uint64_t* dst = n ? &words[0] : 0;
+    const uint64_t* src = n ? &other.words[0] : 0;
+    for (int k = 0; k < n; ++k) {
+        dst[k] ^= src[k];
+    }
+    return *this;
+}
+
+BitMask BitMask::operator&(const BitMask& other) const throw(double) {
+    BitMask result(*this);
+    result &= other;
+    return result;
+}
+
+BitMask BitMask::operator|(const BitMask& other) const throw(double) {
+    BitMask result(*this);
+    result |= other;
+    return result;
+}
+
+BitMask BitMask::operator^(const BitMask& other) const throw(double) {
+    BitMask result(*this);
+    result ^= other;
+    return result;
+}
+
+BitMask BitMask::operator~() const {
+    BitMask result(*this);
+    if (wordsPerRow == 0) return result;
+    uint64_t tail = tailMask();
+    for (int r = 0; r < rows; ++r) {
+        uint64_t* w = result.rowWords(r);
+        for (int k = 0; k < wordsPerRow; ++k) {
+            w[k] = ~w[k];
+        }
+        w[wordsPerRow - 1] &= tail;   // keep the padding bits clear
+    }
+    return result;
+}
+
+long BitMask::popcount() const {
+    long count = 0;
+    int n = rows * wordsPerRow;
+    for (int k = 0; k < n; ++k) {
+        count += countBits(words[k]);
+    }
+    return count;
+}
+
+BitMask BitMask::fromImage(const ImageView& image, double threshold) {
+    BitMask mask(image.getRows(), image.getCols());
+    int rows = mask.rows;
+    int cols = mask.cols;
+    if (mask.wordsPerRow == 0) return mask;
+    bool lazy = image.hasPendingNormalization();
+
+#ifdef _OPENMP
+#pragma omp parallel for if((long)rows * cols >= kParallelPixels)
+#endif
+    for (int i = 0; i < rows; ++i) {
+        const double* src = image.rowPtr(i);
+        uint64_t* dst = mask.rowWords(i);
+        int j = 0;
+#ifdef __SSE2__
+        if (!lazy) {
+            const __m128d t = _mm_set1_pd(threshold);
+            for (; j + 64 <= cols; j += 64) {
+                uint64_t w = 0;
+                for (int k = 0; k < 64; k += 2) {
+                    uint64_t bits = (uint64_t)_mm_movemask_pd(_mm_cmpgt_pd(_mm_loadu_pd(src + j + k), t));
+                    w |= bits << k;
+                }
+                dst[j / 64] = w;
+            }
+        }
+#endif
+        for (; j < cols; ++j) {
+            double v = lazy ? image.normalizedValue(src[j]) : src[j];
+            if (v > threshold) {
+                dst[j / 64] |= (uint64_t)1 << (j % 64);
+            }
+        }
+    }
+    return mask;
+}
+
+Image BitMask::toImage() const {
+    Image image(rows, cols);
+    if (wordsPerRow == 0) return image;
+    for (int i = 0; i < rows; ++i) {
+        const uint64_t* src = rowWords(i);
+        double* dst = image.rowPtr(i);
+        for (int j = 0; j < cols; ++j) {
+            dst[j] = ((src[j / 64] >> (j % 64)) & 1) ? 255.0 : 0.0;
+        }
+    }
+    return image;
+}
+
+bool BitMask::savePBM(const string& filename) const {
+    ofstream file(filename.c_str(), ios::binary);
+    if (!file) return false;
+
+    file << "P4\n" << cols << " " << rows << "\n";
+
+    int bytesPerRow = (cols + 7) / 8;
+    Vector<char> line(bytesPerRow > 0 ? bytesPerRow : 1);
+    // Unused bits of the last byte are written as 0
+    unsigned char lastMask = (unsigned char)(0xFF << ((8 - cols % 8) % 8));
+    for (int i = 0; i < rows && bytesPerRow > 0; ++i) {
+        const uint64_t* src = rowWords(i);
+        for (int b = 0; b < bytesPerRow; ++b) {
+            unsigned char bits = (unsigned char)(src[b / 8] >> (8 * (b % 8)));
+            unsigned char ink = (unsigned char)~reverseBits(bits);
+            line[b] = (char)(b == bytesPerRow - 1 ? (ink & lastMask) : ink);
+        }
+        file.write(&line[0], bytesPerRow);
+    }
+    return !file.fail();
+}
+
+bool BitMask::loadPBM(const string& filename) {
+    ifstream file(filename.c_str(), ios::binary);
+    if (!file) return false;
+
+    string format;
+    file >> format;
+    if (format != "P4") return false;
+
+    int w, h;
+    skipPBMComments(file);
+    file >> w;
+    skipPBMComments(file);
+    file >> h;
+    file.get();   // single whitespace before the raster
+    if (file.fail() || w < 0 || h < 0) return false;
+
+    *this = BitMask(h, w);
+    int bytesPerRow = (w + 7) / 8;
+    Vector<char> line(bytesPerRow > 0 ? bytesPerRow : 1);
+    uint64_t tail = tailMask();
+    for (int i = 0; i < h && bytesPerRow > 0; ++i) {
+        if (!file.read(&line[0], bytesPerRow)) return false;
+        uint64_t* dst = rowWords(i);
+        for (int b = 0; b < bytesPerRow; ++b) {
+            unsigned char bits = reverseBits((unsigned char)~(unsigned char)line[b]);
+            dst[b / 8] |= (uint64_t)bits << (8 * (b % 8));
+        }
+        dst[wordsPerRow - 1] &= tail;
+    }
+    return true;
+}
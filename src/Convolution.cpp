@@ -1,7 +1,12 @@
 #include "Convolution.h"
+#include "FixedTapSum.h"
 #include <cmath>
 #include <iostream>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
@@ -9,12 +14,14 @@
 Convolution::Convolution() : kernel(3, 3), stride(1), paddingMode(Padding_Zero) {
     // Default identity kernel
     kernel.setElement(1, 1, 1.0);
+    plan.compile(kernel);
 }
 
-Convolution::Convolution(const Matrix& k, int s, PaddingMode p) : kernel(k), stride(s), paddingMode(p) {}
+Convolution::Convolution(const Matrix& k, int s, PaddingMode p) : kernel(k), plan(k), stride(s), paddingMode(p) {}
 
 void Convolution::setKernel(const Matrix& k) {
     kernel = k;
+    plan.compile(kernel);
 }
 
 void Convolution::setStride(int s) {
@@ -25,14 +32,332 @@ void Convolution::setPadding(PaddingMode p) {
     paddingMode = p;
 }
 
-Image Convolution::apply(const Image& input) const {
-    int kRows = kernel.getRows();
-    int kCols = kernel.getCols();
+// Copies the input into a (rows + 2 padH) x (cols + 2 padW) buffer so that the
+// strategies below never bounds-check. A pending normalization is applied here.
+void Convolution::padInput(const ImageView& input, int padH, int padW, PaddingMode mode, Vector<double>& out) {
+    int inRows = input.getRows();
+    int inCols = input.getCols();
+    int pw = inCols + 2 * padW;
+    int ph = inRows + 2 * padH;
+    out.resize(pw * ph);
+    double* buf = &out[0];
+    bool lazy = input.hasPendingNormalization();
+    bool replicate = (mode == Padding_Replicate);
+
+    for (int i = 0; i < inRows; ++i) {
+        const double* src = input.rowPtr(i);
+        double* dst = buf + (i + padH) * pw + padW;
+        if (lazy) {
+            for (int j = 0; j < inCols; ++j) {
+                dst[j] = input.normalizedValue(src[j]);
+            }
+        } else {
+            for (int j = 0; j < inCols; ++j) {
+                dst[j] = src[j];
+            }
+        }
+        for (int k = 1; k <= padW; ++k) {
+            dst[-k] = replicate ? dst[0] : 0.0;
+            dst[inCols - 1 + k] = replicate ? dst[inCols - 1] : 0.0;
+        }
+    }
+    for (int k = 1; k <= padH; ++k) {
+        double* top = buf + (padH - k) * pw;
+        double* bottom = buf + (ph - padH - 1 + k) * pw;
+        const double* first = buf + padH * pw;
+        const double* last = buf + (ph - padH - 1) * pw;
+        for (int j = 0; j < pw; ++j) {
+            top[j] = replicate ? first[j] : 0.0;
+            bottom[j] = replicate ? last[j] : 0.0;
+        }
+    }
+}
+
+// 8-bit counterpart of padInput for the integer fast paths. Returns false as soon
+// as a pixel is not an integer in [0, 255].
+bool Convolution::padInput8Bit(const ImageView& input, int padH, int padW, PaddingMode mode,
+                               Vector<unsigned char>& out) {
+    int inRows = input.getRows();
+    int inCols = input.getCols();
+    int pw = inCols + 2 * padW;
+    int ph = inRows + 2 * padH;
+    out.resize(pw * ph);
+    unsigned char* buf = &out[0];
+    bool replicate = (mode == Padding_Replicate);
+
+    for (int i = 0; i < inRows; ++i) {
+        const double* src = input.rowPtr(i);
+        unsigned char* dst = buf + (i + padH) * pw + padW;
+        for (int j = 0; j < inCols; ++j) {
+            double v = src[j];
+            if (!(v >= 0.0 && v <= 255.0)) return false;
+            unsigned char b = (unsigned char)v;
+            if ((double)b != v) return false;
+            dst[j] = b;
+        }
+        for (int k = 1; k <= padW; ++k) {
+            dst[-k] = replicate ? dst[0] : 0;
+            dst[inCols - 1 + k] = replicate ? dst[inCols - 1] : 0;
+        }
+    }
+    for (int k = 1; k <= padH; ++k) {
+        unsigned char* top = buf + (padH - k) * pw;
+        unsigned char* bottom = buf + (ph - padH - 1 + k) * pw;
+        const unsigned char* first = buf + padH * pw;
+        const unsigned char* last = buf + (ph - padH - 1) * pw;
+        for (int j = 0; j < pw; ++j) {
+            top[j] = replicate ? first[j] : 0;
+            bottom[j] = replicate ? last[j] : 0;
+        }
+    }
+    return true;
+}
+
+bool Convolution::is8Bit(const ImageView& input) {
+    bool lazy = input.hasPendingNormalization();
+    for (int i = 0; i < input.getRows(); ++i) {
+        const double* src = input.rowPtr(i);
+        for (int j = 0; j < input.getCols(); ++j) {
+            double v = lazy ? input.normalizedValue(src[j]) : src[j];
+            if (!(v >= 0.0 && v <= 255.0) || (double)(unsigned char)v != v) return false;
+        }
+    }
+    return true;
+}
+
+void Convolution::storeRow(const unsigned char* src, int n, double* dst) {
+    for (int j = 0; j < n; ++j) {
+        dst[j] = (double)src[j];
+    }
+}
+
+void Convolution::storeRow(const double* src, int n, double* dst) {
+    for (int j = 0; j < n; ++j) {
+        dst[j] = src[j];
+    }
+}
+
+// dst[j] += w * src[j * step]
+static void accumulate(double* dst, const double* src, int step, double w, int n) {
+    if (step == 1) {
+        for (int j = 0; j < n; ++j) {
+            dst[j] += w * src[j];
+        }
+    } else {
+        for (int j = 0; j < n; ++j) {
+            dst[j] += w * src[j * step];
+        }
+    }
+}
+
+// Every nonzero tap in row-major order; per pixel the sum runs in the same order
+// as a textbook double loop over the kernel.
+static void runDirect(const KernelPlan& plan, const double* padded, int pw, int stride, Image& output) {
+    int count = plan.getNonzeroCount();
+    int outRows = output.getRows();
+    int outCols = output.getCols();
+    Vector<long> offsetBuf(count > 0 ? count : 1);
+    long* offsets = &offsetBuf[0];
+    for (int t = 0; t < count; ++t) {
+        offsets[t] = (long)plan.getNonzeroRows()[t] * pw + plan.getNonzeroCols()[t];
+    }
+    const double* weights = count > 0 ? &plan.getNonzeroWeights()[0] : NULL;
+
+#ifdef _OPENMP
+#pragma omp parallel for if((long)outRows * outCols >= kParallelPixels)
+#endif
+    for (int i = 0; i < outRows; ++i) {
+        double* dst = output.rowPtr(i);
+        for (int j = 0; j < outCols; ++j) {
+            dst[j] = 0.0;
+        }
+        const double* base = padded + (long)i * stride * pw;
+        for (int t = 0; t < count; ++t) {
+            accumulate(dst, base + offsets[t], stride, weights[t], outCols);
+        }
+    }
+}
+
+// Grouped taps: per pixel one add/subtract per nonzero tap and one multiply per
+// distinct |weight|, instead of K^2 multiplies.
+static void runSparse(const KernelPlan& plan, const double* padded, int pw, int stride, Image& output) {
+    int groups = plan.getGroupCount();
+    int members = plan.getGroupStart()[groups];
+    int outRows = output.getRows();
+    int outCols = output.getCols();
+    if (groups == 0) {
+        for (int i = 0; i < outRows; ++i) {
+            double* dst = output.rowPtr(i);
+            for (int j = 0; j < outCols; ++j) dst[j] = 0.0;
+        }
+        return;
+    }
+
+    // Padded-buffer offsets per group, added taps first: [begin[g], split[g]) are
+    // added and [split[g], begin[g + 1]) subtracted
+    Vector<long> offsetBuf(members);
+    Vector<int> beginBuf(groups + 1);
+    Vector<int> splitBuf(groups);
+    long* offsets = &offsetBuf[0];
+    int* begin = &beginBuf[0];
+    int* split = &splitBuf[0];
+    int k = 0;
+    for (int g = 0; g < groups; ++g) {
+        begin[g] = k;
+        for (int sign = 1; sign >= -1; sign -= 2) {
+            if (sign < 0) split[g] = k;
+            for (int t = plan.getGroupStart()[g]; t < plan.getGroupStart()[g + 1]; ++t) {
+                if (plan.getMemberSigns()[t] != sign) continue;
+                offsets[k++] = (long)plan.getMemberRows()[t] * pw + plan.getMemberCols()[t];
+            }
+        }
+    }
+    begin[groups] = k;
+    const double* weights = &plan.getGroupWeights()[0];
+
+#ifdef _OPENMP
+#pragma omp parallel for if((long)outRows * outCols >= kParallelPixels)
+#endif
+    for (int i = 0; i < outRows; ++i) {
+        double* dst = output.rowPtr(i);
+        const double* base = padded + (long)i * stride * pw;
+        int j = 0;
+#ifdef __SSE2__
+        if (stride == 1) {
+            for (; j + 2 <= outCols; j += 2) {
+                const double* p = base + j;
+                __m128d sum = _mm_setzero_pd();
+                for (int g = 0; g < groups; ++g) {
+                    __m128d acc = _mm_setzero_pd();
+                    for (int t = begin[g]; t < split[g]; ++t) {
+                        acc = _mm_add_pd(acc, _mm_loadu_pd(p + offsets[t]));
+                    }
+                    for (int t = split[g]; t < begin[g + 1]; ++t) {
+                        acc = _mm_sub_pd(acc, _mm_loadu_pd(p + offsets[t]));
+                    }
+                    sum = _mm_add_pd(sum, _mm_mul_pd(_mm_set1_pd(weights[g]), acc));
+                }
+                _mm_storeu_pd(dst + j, sum);
+            }
+        }
+#endif
+        for (; j < outCols; ++j) {
+            const double* p = base + (long)j * stride;
+            double sum = 0.0;
+            for (int g = 0; g < groups; ++g) {
+                double acc = 0.0;
+                for (int t = begin[g]; t < split[g]; ++t) {
+                    acc += p[offsets[t]];
+                }
+                for (int t = split[g]; t < begin[g + 1]; ++t) {
+                    acc -= p[offsets[t]];
+                }
+                sum += weights[g] * acc;
+            }
+            dst[j] = sum;
+        }
+    }
+}
+
+// Stride-1 convolution with the K x K weights held in locals (registers where they fit)
+template <int K>
+static void runFixed(const KernelPlan& plan, const double* padded, int pw, Image& output) {
+    const double* taps = plan.tapData();
+    double w[K * K];
+    for (int t = 0; t < K * K; ++t) {
+        w[t] = taps[t];
+    }
+#ifdef __SSE2__
+    __m128d wv[K * K];
+    for (int t = 0; t < K * K; ++t) {
+        wv[t] = _mm_set1_pd(taps[t]);
+    }
+#endif
+    int outRows = output.getRows();
+    int outCols = output.getCols();
+
+#ifdef _OPENMP
+#pragma omp parallel for if((long)outRows * outCols >= kParallelPixels)
+#endif
+    for (int i = 0; i < outRows; ++i) {
+        const double* rows[K];
+        for (int m = 0; m < K; ++m) {
+            rows[m] = padded + (long)(i + m) * pw;
+        }
+        double* dst = output.rowPtr(i);
+        int j = 0;
+#ifdef __SSE2__
+        for (; j + 2 <= outCols; j += 2) {
+            _mm_storeu_pd(dst + j, FixedTapSum<K, K * K>::run2(rows, j, wv));
+        }
+#endif
+        for (; j < outCols; ++j) {
+            dst[j] = FixedTapSum<K, K * K>::run(rows, j, w);
+        }
+    }
+}
+
+// Row filter over the padded rows that are actually sampled, then the column
+// filter over whole intermediate rows.
+static void runSeparable(const KernelPlan& plan, const double* padded, int pw, int ph, int stride, Image& output) {
+    const Vector<double>& rowFilter = plan.getRowFilter();
+    const Vector<double>& colFilter = plan.getColumnFilter();
+    int kRows = plan.getRows();
+    int kCols = plan.getCols();
+    int outRows = output.getRows();
+    int outCols = output.getCols();
+
+    Vector<int> needed(ph);
+    for (int i = 0; i < outRows; ++i) {
+        for (int m = 0; m < kRows; ++m) {
+            needed[i * stride + m] = 1;
+        }
+    }
+
+    Vector<double> tempBuf(ph * outCols);
+    double* temp = &tempBuf[0];
+#ifdef _OPENMP
+#pragma omp parallel for if((long)ph * outCols >= kParallelPixels)
+#endif
+    for (int y = 0; y < ph; ++y) {
+        if (!needed[y]) continue;
+        double* dst = temp + (long)y * outCols;
+        for (int j = 0; j < outCols; ++j) {
+            dst[j] = 0.0;
+        }
+        const double* src = padded + (long)y * pw;
+        for (int n = 0; n < kCols; ++n) {
+            accumulate(dst, src + n, stride, rowFilter[n], outCols);
+        }
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel for if((long)outRows * outCols >= kParallelPixels)
+#endif
+    for (int i = 0; i < outRows; ++i) {
+        double* dst = output.rowPtr(i);
+        for (int j = 0; j < outCols; ++j) {
+            dst[j] = 0.0;
+        }
+        for (int m = 0; m < kRows; ++m) {
+            accumulate(dst, temp + (long)(i * stride + m) * outCols, 1, colFilter[m], outCols);
+        }
+    }
+}
+
+Image Convolution::execute(const KernelPlan& plan, const ImageView& input, int stride, PaddingMode padding) {
+    return execute(plan, plan.getStrategy(), input, stride, padding);
+}
+
+Image Convolution::execute(const KernelPlan& plan, KernelPlan::Strategy strategy, const ImageView& input,
+                           int stride, PaddingMode padding) {
+    int kRows = plan.getRows();
+    int kCols = plan.getCols();
     int inRows = input.getRows();
     int inCols = input.getCols();
 
     int padH = 0, padW = 0;
-    if (paddingMode != Padding_None) {
+    if (padding != Padding_None) {
         padH = (kRows - 1) / 2;
         padW = (kCols - 1) / 2;
     }
@@ -40,48 +365,47 @@ Image Convolution::apply(const Image& input) const {
     int outRows = (inRows + 2 * padH - kRows) / stride + 1;
     int outCols = (inCols + 2 * padW - kCols) / stride + 1;
 
-    if (outRows <= 0 || outCols <= 0) {
+    if (outRows <= 0 || outCols <= 0 || inRows + 2 * padH < kRows || inCols + 2 * padW < kCols) {
         return Image(0, 0);
     }
 
     Image output(outRows, outCols);
+    if (kRows == 0 || kCols == 0) {
+        return output;
+    }
 
-    for (int i = 0; i < outRows; ++i) {
-        for (int j = 0; j < outCols; ++j) {
-            double sum = 0.0;
-            
-            // Center of the kernel on the input image
-            int startY = i * stride - padH;
-            int startX = j * stride - padW;
-
-            for (int m = 0; m < kRows; ++m) {
-                for (int n = 0; n < kCols; ++n) {
-                    int imgY = startY + m;
-                    int imgX = startX + n;
-
-                    double pixelVal = 0.0;
-
-                    if (imgY >= 0 && imgY < inRows && imgX >= 0 && imgX < inCols) {
-                        pixelVal = input.getElement(imgY, imgX);
-                    } else {
-                        if (paddingMode == Padding_Zero) {
-                            pixelVal = 0.0;
-                        } else if (paddingMode == Padding_Replicate) {
-                            int clampedY = imgY < 0 ? 0 : (imgY >= inRows ? inRows - 1 : imgY);
-                            int clampedX = imgX < 0 ? 0 : (imgX >= inCols ? inCols - 1 : imgX);
-                            pixelVal = input.getElement(clampedY, clampedX);
-                        }
-                    }
-                    sum += pixelVal * kernel.getElement(m, n);
-                }
-            }
-            output.setElement(i, j, sum);
+    Vector<double> padded;
+    padInput(input, padH, padW, padding, padded);
+    int pw = inCols + 2 * padW;
+    int ph = inRows + 2 * padH;
+
+    if (strategy == KernelPlan::Strategy_FixedSize && stride == 1 && plan.hasFixedSize()) {
+        switch (kRows) {
+            case 3: runFixed<3>(plan, &padded[0], pw, output); break;
+            case 5: runFixed<5>(plan, &padded[0], pw, output); break;
+            default: runFixed<7>(plan, &padded[0], pw, output); break;
         }
+    } else if (strategy == KernelPlan::Strategy_Sparse) {
+        runSparse(plan, &padded[0], pw, stride, output);
+    } else if (strategy == KernelPlan::Strategy_Separable ||
+               (strategy == KernelPlan::Strategy_FixedSize && plan.isSeparable())) {
+        runSeparable(plan, &padded[0], pw, ph, stride, output);
+    } else {
+        runDirect(plan, &padded[0], pw, stride, output);
     }
-
     return output;
 }
 
+Image Convolution::apply(const ImageView& input) const {
+    return execute(plan, input, stride, paddingMode);
+}
+
+// Padding is (k - 1) / 2 before and k / 2 after, so k / 2 bounds both sides
+int Convolution::getRadius() const {
+    int k = plan.getRows() > plan.getCols() ? plan.getRows() : plan.getCols();
+    return k / 2;
+}
+
 Matrix Convolution::createIdentityKernel(int size) {
     Matrix k(size, size);
     int center = size / 2;
@@ -0,0 +1,325 @@
+#include "FilterBank.h"
+#include "FixedTapSum.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Output pixels per im2col block: the patch matrix stays in cache while it is multiplied
+static const int kIm2colBlock = 256;
+
+FilterBank::FilterBank(int s, Convolution::PaddingMode p)
+    : kRows(0), kCols(0), count(0), stride(s), paddingMode(p), method(Method_Auto) {}
+
+void FilterBank::addKernel(const Matrix& k) throw(int) {
+    if (count > 0 && (k.getRows() != kRows || k.getCols() != kCols)) throw -1;
+    kRows = k.getRows();
+    kCols = k.getCols();
+    int taps = kRows * kCols;
+
+    Matrix grown(count + 1, taps);
+    for (int f = 0; f < count; ++f) {
+        for (int t = 0; t < taps; ++t) {
+            grown.setElement(f, t, weights.getElement(f, t));
+        }
+    }
+    for (int t = 0; t < taps; ++t) {
+        grown.setElement(count, t, k.getElement(t / kCols, t % kCols));
+    }
+    weights = grown;
+    ++count;
+}
+
+void FilterBank::clear() {
+    weights = Matrix();
+    kRows = kCols = count = 0;
+}
+
+void FilterBank::setStride(int s) {
+    stride = s;
+}
+
+void FilterBank::setPadding(Convolution::PaddingMode p) {
+    paddingMode = p;
+}
+
+void FilterBank::setMethod(Method m) {
+    method = m;
+}
+
+#ifdef __SSE2__
+// G kernels starting at first, for output pixels j and j + 1
+template <int K, int G>
+static inline void storeBankGroup(const double* const* rows, int j, const __m128d* wv, int first, double** dst) {
+    __m128d acc[G];
+    for (int g = 0; g < G; ++g) {
+        acc[g] = _mm_setzero_pd();
+    }
+    const __m128d* w = wv + first * K * K;
+    for (int m = 0; m < K; ++m) {
+        FixedBankRow<K, K, G>::run2(rows[m] + j, w + m * K, acc);
+    }
+    for (int g = 0; g < G; ++g) {
+        _mm_storeu_pd(dst[first + g] + j, acc[g]);
+    }
+}
+#endif
+
+// Unrolled loop for a K x K bank at stride 1: for each output pixel pair every
+// tap is loaded once and applied to a group of up to eight kernels held in
+// registers (larger banks take several groups). Results match Convolution's
+// fixed-size path.
+template <int K>
+static void runFixedBank(const Matrix& weights, int count, const double* padded, int pw, Image outputs[]) {
+    const int taps = K * K;
+    int outRows = outputs[0].getRows();
+    int outCols = outputs[0].getCols();
+
+#ifdef _OPENMP
+#pragma omp parallel if((long)outRows * outCols >= kParallelPixels)
+#endif
+    {
+        double** dst = new double*[count];
+        Vector<double> flatBuf(taps * count);
+        double* flat = &flatBuf[0];
+        for (int f = 0; f < count; ++f) {
+            for (int t = 0; t < taps; ++t) {
+                flat[f * taps + t] = weights.rowPtr(f)[t];
+            }
+        }
+#ifdef __SSE2__
+        __m128d* wv = new __m128d[taps * count];
+        for (int t = 0; t < taps * count; ++t) {
+            wv[t] = _mm_set1_pd(flat[t]);
+        }
+#endif
+
+#ifdef _OPENMP
+#pragma omp for
+#endif
+        for (int i = 0; i < outRows; ++i) {
+            const double* rows[K];
+            for (int m = 0; m < K; ++m) {
+                rows[m] = padded + (long)(i + m) * pw;
+            }
+            for (int f = 0; f < count; ++f) {
+                dst[f] = outputs[f].rowPtr(i);
+            }
+            int j = 0;
+#ifdef __SSE2__
+            for (; j + 2 <= outCols; j += 2) {
+                int f = 0;
+                for (; f + 8 <= count; f += 8) storeBankGroup<K, 8>(rows, j, wv, f, dst);
+                if (f + 4 <= count) { storeBankGroup<K, 4>(rows, j, wv, f, dst); f += 4; }
+                if (f + 2 <= count) { storeBankGroup<K, 2>(rows, j, wv, f, dst); f += 2; }
+                if (f < count) storeBankGroup<K, 1>(rows, j, wv, f, dst);
+            }
+#endif
+            for (; j < outCols; ++j) {
+                for (int f = 0; f < count; ++f) {
+                    dst[f][j] = FixedTapSum<K, K * K>::run(rows, j, flat + f * taps);
+                }
+            }
+        }
+        delete[] dst;
+#ifdef __SSE2__
+        delete[] wv;
+#endif
+    }
+}
+
+// Loads each neighbourhood once (four output pixels in two SSE2 registers per tap)
+// and takes the dot product with every kernel's nonzero taps. Per pixel the taps
+// are summed in row-major order, as in Convolution's direct path.
+void FilterBank::applyNeighbourhood(const double* padded, int pw, int stride, Image outputs[]) const {
+    int taps = kRows * kCols;
+    int outRows = outputs[0].getRows();
+    int outCols = outputs[0].getCols();
+
+    // Per kernel: indices into the neighbourhood and weights of its nonzero taps
+    Vector<int> tapIndex(taps * count);
+    Vector<double> tapWeight(taps * count);
+    Vector<int> tapCount(count);
+    for (int f = 0; f < count; ++f) {
+        const double* w = weights.rowPtr(f);
+        int n = 0;
+        for (int t = 0; t < taps; ++t) {
+            if (w[t] == 0.0) continue;
+            tapIndex[f * taps + n] = t;
+            tapWeight[f * taps + n] = w[t];
+            ++n;
+        }
+        tapCount[f] = n;
+    }
+    Vector<long> offsetBuf(taps);
+    for (int t = 0; t < taps; ++t) {
+        offsetBuf[t] = (long)(t / kCols) * pw + t % kCols;
+    }
+    const int* index = &tapIndex[0];
+    const double* weight = &tapWeight[0];
+    const int* counts = &tapCount[0];
+    const long* offsets = &offsetBuf[0];
+
+#ifdef _OPENMP
+#pragma omp parallel if((long)outRows * outCols >= kParallelPixels)
+#endif
+    {
+        double** dst = new double*[count];
+#ifdef __SSE2__
+        __m128d* patch = new __m128d[2 * taps];
+        __m128d* wv = new __m128d[taps * count];
+        for (int t = 0; t < taps * count; ++t) {
+            wv[t] = _mm_set1_pd(weight[t]);
+        }
+#endif
+        Vector<double> scalarBuf(taps);
+        double* scalarPatch = &scalarBuf[0];
+
+#ifdef _OPENMP
+#pragma omp for
+#endif
+        for (int i = 0; i < outRows; ++i) {
+            for (int f = 0; f < count; ++f) {
+                dst[f] = outputs[f].rowPtr(i);
+            }
+            const double* base = padded + (long)i * stride * pw;
+            int j = 0;
+#ifdef __SSE2__
+            if (stride == 1) {
+                for (; j + 4 <= outCols; j += 4) {
+                    for (int t = 0; t < taps; ++t) {
+                        patch[2 * t] = _mm_loadu_pd(base + j + offsets[t]);
+                        patch[2 * t + 1] = _mm_loadu_pd(base + j + 2 + offsets[t]);
+                    }
+                    for (int f = 0; f < count; ++f) {
+                        const int* idx = index + f * taps;
+                        const __m128d* w = wv + f * taps;
+                        __m128d lo = _mm_setzero_pd();
+                        __m128d hi = _mm_setzero_pd();
+                        for (int n = 0; n < counts[f]; ++n) {
+                            lo = _mm_add_pd(lo, _mm_mul_pd(w[n], patch[2 * idx[n]]));
+                            hi = _mm_add_pd(hi, _mm_mul_pd(w[n], patch[2 * idx[n] + 1]));
+                        }
+                        _mm_storeu_pd(dst[f] + j, lo);
+                        _mm_storeu_pd(dst[f] + j + 2, hi);
+                    }
+                }
+            }
+#endif
+            for (; j < outCols; ++j) {
+                const double* p = base + (long)j * stride;
+                for (int t = 0; t < taps; ++t) {
+                    scalarPatch[t] = p[offsets[t]];
+                }
+                for (int f = 0; f < count; ++f) {
+                    const int* idx = index + f * taps;
+                    const double* w = weight + f * taps;
+                    double sum = 0.0;
+                    for (int n = 0; n < counts[f]; ++n) {
+                        sum += w[n] * scalarPatch[idx[n]];
+                    }
+                    dst[f][j] = sum;
+                }
+            }
+        }
+        delete[] dst;
+#ifdef __SSE2__
+        delete[] patch;
+        delete[] wv;
+#endif
+    }
+}
+
+// im2col: a run of up to kIm2colBlock output pixels along one row becomes a
+// (taps x pixels) patch matrix, and its blocked product with the (kernels x
+// taps) weight matrix yields that run of every output plane. Both matrices are
+// allocated once per thread; the product's inner loop walks the pixels
+// contiguously.
+void FilterBank::applyIm2col(const double* padded, int pw, int stride, Image outputs[]) const {
+    int taps = kRows * kCols;
+    int outRows = outputs[0].getRows();
+    int outCols = outputs[0].getCols();
+    int runsPerRow = (outCols + kIm2colBlock - 1) / kIm2colBlock;
+    int width = outCols < kIm2colBlock ? outCols : kIm2colBlock;
+
+#ifdef _OPENMP
+#pragma omp parallel if((long)outRows * outCols >= kParallelPixels)
+#endif
+    {
+        Matrix patches(taps, width);
+        Matrix product(count, width);
+#ifdef _OPENMP
+#pragma omp for
+#endif
+        for (int r = 0; r < outRows * runsPerRow; ++r) {
+            int i = r / runsPerRow;
+            int j0 = (r % runsPerRow) * kIm2colBlock;
+            int n = outCols - j0 < width ? outCols - j0 : width;
+
+            for (int t = 0; t < taps; ++t) {
+                const double* src = padded + (long)(i * stride + t / kCols) * pw + (long)j0 * stride + t % kCols;
+                double* row = patches.rowPtr(t);
+                for (int k = 0; k < n; ++k) {
+                    row[k] = src[(long)k * stride];
+                }
+                for (int k = n; k < width; ++k) {
+                    row[k] = 0.0;
+                }
+            }
+
+            weights.multiplyInto(patches, product);
+            for (int f = 0; f < count; ++f) {
+                const double* src = product.rowPtr(f);
+                double* dst = outputs[f].rowPtr(i) + j0;
+                for (int k = 0; k < n; ++k) {
+                    dst[k] = src[k];
+                }
+            }
+        }
+    }
+}
+
+void FilterBank::apply(const ImageView& input, Image outputs[]) const {
+    apply(input, outputs, stride, paddingMode);
+}
+
+void FilterBank::apply(const ImageView& input, Image outputs[], int s, Convolution::PaddingMode p) const {
+    if (count == 0) return;
+    int inRows = input.getRows();
+    int inCols = input.getCols();
+
+    int padH = 0, padW = 0;
+    if (p != Convolution::Padding_None) {
+        padH = (kRows - 1) / 2;
+        padW = (kCols - 1) / 2;
+    }
+
+    bool empty = inRows + 2 * padH < kRows || inCols + 2 * padW < kCols || kRows == 0 || kCols == 0;
+    int outRows = empty ? 0 : (inRows + 2 * padH - kRows) / s + 1;
+    int outCols = empty ? 0 : (inCols + 2 * padW - kCols) / s + 1;
+    // Release the old contents, then size in place (assigning a fresh
+    // Image would deep-copy a zeroed buffer per output)
+    for (int f = 0; f < count; ++f) {
+        outputs[f] = Image();
+        outputs[f].resize(outRows, outCols);
+    }
+    if (empty) return;
+
+    Vector<double> padded;
+    Convolution::padInput(input, padH, padW, p, padded);
+    int pw = inCols + 2 * padW;
+
+    // With Matrix's blocked product, im2col measured slower than the neighbourhood
+    // path for every bank size and kernel size tried (2-32 kernels, 3x3-13x13)
+    if (method == Method_Im2col) {
+        applyIm2col(&padded[0], pw, s, outputs);
+    } else if (method == Method_Auto && s == 1 && kRows == kCols && (kRows == 3 || kRows == 5 || kRows == 7)) {
+        switch (kRows) {
+            case 3: runFixedBank<3>(weights, count, &padded[0], pw, outputs); break;
+            case 5: runFixedBank<5>(weights, count, &padded[0], pw, outputs); break;
+            default: runFixedBank<7>(weights, count, &padded[0], pw, outputs); break;
+        }
+    } else {
+        applyNeighbourhood(&padded[0], pw, s, outputs);
+    }
+}
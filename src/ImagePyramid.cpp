@@ -0,0 +1,174 @@
+#include "ImagePyramid.h"
+#include <cmath>
+
+ImagePyramid::ImagePyramid(int levelCount, int kernelSize, double sigma)
+    : levels(0), requestedLevels(levelCount), paddingMode(Convolution::Padding_Replicate) {
+    if (kernelSize < 1) kernelSize = 1;
+    taps.resize(kernelSize);
+
+    // 1D Gaussian; its outer product equals Convolution::createGaussianKernel
+    double sum = 0.0;
+    int center = kernelSize / 2;
+    for (int i = 0; i < kernelSize; ++i) {
+        int x = i - center;
+        taps[i] = exp(-(x * x) / (2.0 * sigma * sigma));
+        sum += taps[i];
+    }
+    for (int i = 0; i < kernelSize; ++i) {
+        taps[i] /= sum;
+    }
+}
+
+void ImagePyramid::setPadding(Convolution::PaddingMode p) {
+    paddingMode = p;
+}
+
+// Blur + decimate by 2 in one pass. Equivalent to Convolution(gaussian, 2, paddingMode),
+// but the horizontal pass only visits kept columns and the vertical pass only kept rows.
+void ImagePyramid::downsample(const double* src, int inRows, int inCols,
+                              double* dst, int outRows, int outCols, double* temp) const {
+    int k = taps.getsize();
+    int pad = (paddingMode == Convolution::Padding_None) ? 0 : (k - 1) / 2;
+    const double* g = &taps[0];
+
+    // Horizontal pass: temp[y][j] = sum_n g[n] * src[y][2j - pad + n]
+    for (int y = 0; y < inRows; ++y) {
+        const double* row = src + y * inCols;
+        double* out = temp + y * outCols;
+        for (int j = 0; j < outCols; ++j) {
+            int start = 2 * j - pad;
+            double sum = 0.0;
+            if (start >= 0 && start + k <= inCols) {
+                const double* p = row + start;
+                for (int n = 0; n < k; ++n) {
+                    sum += g[n] * p[n];
+                }
+            } else {
+                for (int n = 0; n < k; ++n) {
+                    int x = start + n;
+                    if (x < 0 || x >= inCols) {
+                        if (paddingMode != Convolution::Padding_Replicate) continue;
+                        x = x < 0 ? 0 : inCols - 1;
+                    }
+                    sum += g[n] * row[x];
+                }
+            }
+            out[j] = sum;
+        }
+    }
+
+    // Vertical pass over whole rows: dst[i] = sum_m g[m] * temp[2i - pad + m]
+    for (int i = 0; i < outRows; ++i) {
+        double* out = dst + i * outCols;
+        for (int j = 0; j < outCols; ++j) {
+            out[j] = 0.0;
+        }
+        for (int m = 0; m < k; ++m) {
+            int y = 2 * i - pad + m;
+            if (y < 0 || y >= inRows) {
+                if (paddingMode != Convolution::Padding_Replicate) continue;
+                y = y < 0 ? 0 : inRows - 1;
+            }
+            const double* t = temp + y * outCols;
+            double w = g[m];
+            for (int j = 0; j < outCols; ++j) {
+                out[j] += w * t[j];
+            }
+        }
+    }
+}
+
+void ImagePyramid::build(const ImageView& input) {
+    int k = taps.getsize();
+    int pad = (paddingMode == Convolution::Padding_None) ? 0 : (k - 1) / 2;
+
+    // Work out every level's size first so all of them fit in one allocation
+    Vector<int> rows(requestedLevels > 0 ? requestedLevels : 0);
+    Vector<int> cols(rows.getsize());
+    int count = 0;
+    int total = 0;
+    int r = input.getRows();
+    int c = input.getCols();
+    while (count < requestedLevels && r > 0 && c > 0) {
+        rows[count] = r;
+        cols[count] = c;
+        total += r * c;
+        ++count;
+        if (r == 1 && c == 1) break;
+        r = (r + 2 * pad < k) ? 0 : (r + 2 * pad - k) / 2 + 1;
+        c = (c + 2 * pad < k) ? 0 : (c + 2 * pad - k) / 2 + 1;
+    }
+
+    levels = count;
+    levelRows.resize(count);
+    levelCols.resize(count);
+    offsets.resize(count);
+    storage.resize(total);
+    if (count == 0) return;
+
+    int offset = 0;
+    for (int l = 0; l < count; ++l) {
+        levelRows[l] = rows[l];
+        levelCols[l] = cols[l];
+        offsets[l] = offset;
+        offset += rows[l] * cols[l];
+    }
+
+    // Level 0 is a copy of the input; a pending normalization is applied on the way
+    double* base = &storage[0];
+    bool lazy = input.hasPendingNormalization();
+    for (int i = 0; i < rows[0]; ++i) {
+        const double* src = input.rowPtr(i);
+        double* dst = base + i * cols[0];
+        for (int j = 0; j < cols[0]; ++j) {
+            dst[j] = lazy ? input.normalizedValue(src[j]) : src[j];
+        }
+    }
+
+    if (count > 1) {
+        // Scratch for the horizontal pass: input rows x decimated columns
+        Vector<double> temp(rows[0] * cols[1]);
+        for (int l = 1; l < count; ++l) {
+            downsample(base + offsets[l - 1], rows[l - 1], cols[l - 1],
+                       base + offsets[l], rows[l], cols[l], &temp[0]);
+        }
+    }
+}
+
+int ImagePyramid::getLevelRows(int level) const throw(int) {
+    if (level < 0 || level >= levels) throw -1;
+    return levelRows[level];
+}
+
+int ImagePyramid::getLevelCols(int level) const throw(int) {
+    if (level < 0 || level >= levels) throw -1;
+    return levelCols[level];
+}
+
+const double* ImagePyramid::levelData(int level) const throw(int) {
+    if (level < 0 || level >= levels) throw -1;
+    return &storage[offsets[level]];
+}
+
+Image ImagePyramid::getLevel(int level) const throw(int) {
+    const double* src = levelData(level);
+    int r = levelRows[level];
+    int c = levelCols[level];
+    Image img(r, c);
+    for (int i = 0; i < r; ++i) {
+        double* dst = img.rowPtr(i);
+        for (int j = 0; j < c; ++j) {
+            dst[j] = src[i * c + j];
+        }
+    }
+    return img;
+}
+
+ImageView ImagePyramid::levelView(int level) const throw(int) {
+    const double* src = levelData(level);
+    return ImageView(src, levelRows[level], levelCols[level], levelCols[level]);
+}
+
+Image ImagePyramid::detectEdges(int level, const SobelDetector& sobel) const throw(int) {
+    return sobel.apply(levelView(level));
+}
@@ -0,0 +1,149 @@
+#include "KernelPlan.h"
+#include <cmath>
+
+KernelPlan::KernelPlan() : rows(0), cols(0), separable(false), strategy(Strategy_Direct) {}
+
+KernelPlan::KernelPlan(const Matrix& kernel) : rows(0), cols(0), separable(false), strategy(Strategy_Direct) {
+    compile(kernel);
+}
+
+void KernelPlan::compile(const Matrix& kernel) {
+    rows = kernel.getRows();
+    cols = kernel.getCols();
+    taps.resize(rows * cols);
+
+    int count = 0;
+    for (int m = 0; m < rows; ++m) {
+        for (int n = 0; n < cols; ++n) {
+            double w = kernel.getElement(m, n);
+            taps[m * cols + n] = w;
+            if (w != 0.0) ++count;
+        }
+    }
+
+    nonzeroRows.resize(count);
+    nonzeroCols.resize(count);
+    nonzeroWeights.resize(count);
+    int k = 0;
+    for (int m = 0; m < rows; ++m) {
+        for (int n = 0; n < cols; ++n) {
+            double w = taps[m * cols + n];
+            if (w != 0.0) {
+                nonzeroRows[k] = m;
+                nonzeroCols[k] = n;
+                nonzeroWeights[k] = w;
+                ++k;
+            }
+        }
+    }
+
+    detectSeparable();
+    buildGroups();
+
+    // Rough per-pixel operation counts. Up to 7x7 the unrolled single pass beats
+    // the others unless the kernel is mostly zeros or repeated weights.
+    int groups = getGroupCount();
+    int sparseCost = count + 2 * groups;
+    if (hasFixedSize() && 2 * sparseCost >= rows * cols) {
+        strategy = Strategy_FixedSize;
+    } else {
+        int directCost = 2 * count;
+        int separableCost = separable ? 2 * (rows + cols) + 8 : directCost + 1;
+        strategy = Strategy_Direct;
+        int best = directCost;
+        if (sparseCost < best) {
+            strategy = Strategy_Sparse;
+            best = sparseCost;
+        }
+        if (separableCost < best) {
+            strategy = Strategy_Separable;
+        }
+    }
+}
+
+bool KernelPlan::supports(Strategy s, int stride) const {
+    switch (s) {
+        case Strategy_FixedSize: return hasFixedSize() && stride == 1;
+        case Strategy_Separable: return separable;
+        default: return true;
+    }
+}
+
+// Rank-1 test: pivot on the largest tap, then check every tap against the outer product.
+void KernelPlan::detectSeparable() {
+    separable = false;
+    rowFilter.resize(0);
+    columnFilter.resize(0);
+    if (rows == 0 || cols == 0) return;
+
+    int pr = 0, pc = 0;
+    double maxAbs = 0.0;
+    for (int m = 0; m < rows; ++m) {
+        for (int n = 0; n < cols; ++n) {
+            double a = fabs(taps[m * cols + n]);
+            if (a > maxAbs) {
+                maxAbs = a;
+                pr = m;
+                pc = n;
+            }
+        }
+    }
+    if (maxAbs == 0.0) return;
+
+    Vector<double> colF(rows);
+    Vector<double> rowF(cols);
+    double pivot = taps[pr * cols + pc];
+    for (int m = 0; m < rows; ++m) {
+        colF[m] = taps[m * cols + pc];
+    }
+    for (int n = 0; n < cols; ++n) {
+        rowF[n] = taps[pr * cols + n] / pivot;
+    }
+
+    double tolerance = maxAbs * 1e-12;
+    for (int m = 0; m < rows; ++m) {
+        for (int n = 0; n < cols; ++n) {
+            if (fabs(taps[m * cols + n] - colF[m] * rowF[n]) > tolerance) return;
+        }
+    }
+
+    separable = true;
+    rowFilter = rowF;
+    columnFilter = colF;
+}
+
+// Groups nonzero taps by absolute weight, so mirrored pairs of a symmetric
+// (w, w) or antisymmetric (w, -w) kernel share one multiply: (a + b) * w or (a - b) * w.
+void KernelPlan::buildGroups() {
+    int count = nonzeroWeights.getsize();
+    Vector<int> groupOf(count);
+    Vector<double> weights(count);
+    int groups = 0;
+    for (int t = 0; t < count; ++t) {
+        double a = fabs(nonzeroWeights[t]);
+        int g = 0;
+        while (g < groups && weights[g] != a) ++g;
+        if (g == groups) weights[groups++] = a;
+        groupOf[t] = g;
+    }
+
+    groupWeights.resize(groups);
+    groupStart.resize(groups + 1);
+    memberRows.resize(count);
+    memberCols.resize(count);
+    memberSigns.resize(count);
+
+    int k = 0;
+    for (int g = 0; g < groups; ++g) {
+        groupWeights[g] = weights[g];
+        groupStart[g] = k;
+        for (int t = 0; t < count; ++t) {
+            if (groupOf[t] != g) continue;
+            memberRows[k] = nonzeroRows[t];
+            memberCols[k] = nonzeroCols[t];
+            memberSigns[k] = nonzeroWeights[t] < 0 ? -1 : 1;
+            ++k;
+        }
+    }
+    groupStart[groups] = k;
+}
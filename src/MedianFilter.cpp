@@ -0,0 +1,370 @@
+#include "MedianFilter.h"
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Output rows per histogram band. Each band rebuilds its column histograms from
+// (size - 1) rows, so bands trade setup cost against parallel slack.
+static const int kBandRows = 64;
+
+// Pruned Batcher-style selection network for the median of 25 (Devillard,
+// "Fast median search"); after these compare-exchanges element 12 is the median.
+static const unsigned char kMedian25Network[99][2] = {
+    {0, 1}, {3, 4}, {2, 4}, {2, 3}, {6, 7}, {5, 7}, {5, 6}, {9, 10}, {8, 10}, {8, 9},
+    {12, 13}, {11, 13}, {11, 12}, {15, 16}, {14, 16}, {14, 15}, {18, 19}, {17, 19}, {17, 18}, {21, 22},
+    {20, 22}, {20, 21}, {23, 24}, {2, 5}, {3, 6}, {0, 6}, {0, 3}, {4, 7}, {1, 7}, {1, 4},
+    {11, 14}, {8, 14}, {8, 11}, {12, 15}, {9, 15}, {9, 12}, {13, 16}, {10, 16}, {10, 13}, {20, 23},
+    {17, 23}, {17, 20}, {21, 24}, {18, 24}, {18, 21}, {19, 22}, {8, 17}, {9, 18}, {0, 18}, {0, 9},
+    {10, 19}, {1, 19}, {1, 10}, {11, 20}, {2, 20}, {2, 11}, {12, 21}, {3, 21}, {3, 12}, {13, 22},
+    {4, 22}, {4, 13}, {14, 23}, {5, 23}, {5, 14}, {15, 24}, {6, 24}, {6, 15}, {7, 16}, {7, 19},
+    {13, 21}, {15, 23}, {7, 13}, {7, 15}, {1, 9}, {3, 11}, {5, 17}, {11, 17}, {9, 17}, {4, 10},
+    {6, 12}, {7, 14}, {4, 6}, {4, 7}, {12, 14}, {10, 14}, {6, 7}, {10, 12}, {6, 10}, {6, 17},
+    {12, 17}, {7, 17}, {7, 10}, {12, 18}, {7, 12}, {10, 18}, {12, 20}, {10, 20}, {10, 12}
+};
+
+// min/max on single pixels and on 16 pixels at once, so the networks below are
+// written once for both
+static inline unsigned char lower(unsigned char a, unsigned char b) { return a < b ? a : b; }
+static inline unsigned char upper(unsigned char a, unsigned char b) { return a < b ? b : a; }
+#ifdef __SSE2__
+static inline __m128i lower(__m128i a, __m128i b) { return _mm_min_epu8(a, b); }
+static inline __m128i upper(__m128i a, __m128i b) { return _mm_max_epu8(a, b); }
+#endif
+
+template <class T>
+static inline T median3(T a, T b, T c) {
+    return upper(lower(a, b), lower(upper(a, b), c));
+}
+
+template <class T>
+static inline T median25(T* p) {
+    for (int c = 0; c < 99; ++c) {
+        T& a = p[kMedian25Network[c][0]];
+        T& b = p[kMedian25Network[c][1]];
+        T lo = lower(a, b);
+        b = upper(a, b);
+        a = lo;
+    }
+    return p[12];
+}
+
+// 3x3: each padded column is sorted once and shared by the three windows that
+// contain it; the median is then med3(max of lows, med3 of mids, min of highs).
+static void median3x3(const unsigned char* padded, int pw, Image& output) {
+    int outRows = output.getRows();
+    int outCols = output.getCols();
+
+#ifdef _OPENMP
+#pragma omp parallel if((long)outRows * outCols >= kParallelPixels)
+#endif
+    {
+        Vector<unsigned char> sortedBuf(3 * pw + outCols);
+        unsigned char* lo = &sortedBuf[0];
+        unsigned char* mid = lo + pw;
+        unsigned char* hi = mid + pw;
+        unsigned char* out = hi + pw;
+
+#ifdef _OPENMP
+#pragma omp for
+#endif
+        for (int i = 0; i < outRows; ++i) {
+            const unsigned char* r0 = padded + (long)i * pw;
+            const unsigned char* r1 = r0 + pw;
+            const unsigned char* r2 = r1 + pw;
+
+            int c = 0;
+#ifdef __SSE2__
+            for (; c + 16 <= pw; c += 16) {
+                __m128i a = _mm_loadu_si128((const __m128i*)(r0 + c));
+                __m128i b = _mm_loadu_si128((const __m128i*)(r1 + c));
+                __m128i d = _mm_loadu_si128((const __m128i*)(r2 + c));
+                __m128i ab = _mm_min_epu8(a, b);
+                __m128i ba = _mm_max_epu8(a, b);
+                _mm_storeu_si128((__m128i*)(lo + c), _mm_min_epu8(ab, d));
+                _mm_storeu_si128((__m128i*)(mid + c), median3(a, b, d));
+                _mm_storeu_si128((__m128i*)(hi + c), _mm_max_epu8(ba, d));
+            }
+#endif
+            for (; c < pw; ++c) {
+                lo[c] = lower(lower(r0[c], r1[c]), r2[c]);
+                mid[c] = median3(r0[c], r1[c], r2[c]);
+                hi[c] = upper(upper(r0[c], r1[c]), r2[c]);
+            }
+
+            int j = 0;
+#ifdef __SSE2__
+            for (; j + 16 <= outCols; j += 16) {
+                __m128i maxLo = upper(upper(_mm_loadu_si128((const __m128i*)(lo + j)),
+                                            _mm_loadu_si128((const __m128i*)(lo + j + 1))),
+                                      _mm_loadu_si128((const __m128i*)(lo + j + 2)));
+                __m128i medMid = median3(_mm_loadu_si128((const __m128i*)(mid + j)),
+                                         _mm_loadu_si128((const __m128i*)(mid + j + 1)),
+                                         _mm_loadu_si128((const __m128i*)(mid + j + 2)));
+                __m128i minHi = lower(lower(_mm_loadu_si128((const __m128i*)(hi + j)),
+                                            _mm_loadu_si128((const __m128i*)(hi + j + 1))),
+                                      _mm_loadu_si128((const __m128i*)(hi + j + 2)));
+                _mm_storeu_si128((__m128i*)(out + j), median3(maxLo, medMid, minHi));
+            }
+#endif
+            for (; j < outCols; ++j) {
+                unsigned char maxLo = upper(upper(lo[j], lo[j + 1]), lo[j + 2]);
+                unsigned char medMid = median3(mid[j], mid[j + 1], mid[j + 2]);
+                unsigned char minHi = lower(lower(hi[j], hi[j + 1]), hi[j + 2]);
+                out[j] = median3(maxLo, medMid, minHi);
+            }
+            Convolution::storeRow(out, outCols, output.rowPtr(i));
+        }
+    }
+}
+
+// 5x5: the selection network runs on 16 neighbouring windows at a time
+static void median5x5(const unsigned char* padded, int pw, Image& output) {
+    int outRows = output.getRows();
+    int outCols = output.getCols();
+
+#ifdef _OPENMP
+#pragma omp parallel if((long)outRows * outCols >= kParallelPixels)
+#endif
+    {
+        Vector<unsigned char> outBuf(outCols);
+        unsigned char* out = &outBuf[0];
+
+#ifdef _OPENMP
+#pragma omp for
+#endif
+        for (int i = 0; i < outRows; ++i) {
+            const unsigned char* rows[5];
+            for (int m = 0; m < 5; ++m) {
+                rows[m] = padded + (long)(i + m) * pw;
+            }
+
+            int j = 0;
+#ifdef __SSE2__
+            for (; j + 16 <= outCols; j += 16) {
+                __m128i p[25];
+                for (int t = 0; t < 25; ++t) {
+                    p[t] = _mm_loadu_si128((const __m128i*)(rows[t / 5] + j + t % 5));
+                }
+                _mm_storeu_si128((__m128i*)(out + j), median25(p));
+            }
+#endif
+            for (; j < outCols; ++j) {
+                unsigned char p[25];
+                for (int t = 0; t < 25; ++t) {
+                    p[t] = rows[t / 5][j + t % 5];
+                }
+                out[j] = median25(p);
+            }
+            Convolution::storeRow(out, outCols, output.rowPtr(i));
+        }
+    }
+}
+
+// dst[k] += add[k] - sub[k] for one 16-bin histogram slice
+static inline void slideCounts(unsigned short* dst, const unsigned short* add, const unsigned short* sub) {
+#ifdef __SSE2__
+    for (int k = 0; k < 16; k += 8) {
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + k));
+        d = _mm_add_epi16(d, _mm_loadu_si128((const __m128i*)(add + k)));
+        d = _mm_sub_epi16(d, _mm_loadu_si128((const __m128i*)(sub + k)));
+        _mm_storeu_si128((__m128i*)(dst + k), d);
+    }
+#else
+    for (int k = 0; k < 16; ++k) {
+        dst[k] = (unsigned short)(dst[k] + add[k] - sub[k]);
+    }
+#endif
+}
+
+static inline void addCounts(unsigned short* dst, const unsigned short* add) {
+    for (int k = 0; k < 16; ++k) {
+        dst[k] = (unsigned short)(dst[k] + add[k]);
+    }
+}
+
+// Perreault-Hebert: every padded column keeps a 16-bin coarse and a 256-bin fine
+// histogram of its `size` pixels. The window histogram slides by one column add
+// and one column subtract; fine bins are only brought up to date for the coarse
+// bucket that holds the median, so the cost per pixel does not depend on size.
+static void medianHistogram(const unsigned char* padded, int pw, int size, Image& output) {
+    int outRows = output.getRows();
+    int outCols = output.getCols();
+    int rank = (size * size - 1) / 2;
+    int bands = (outRows + kBandRows - 1) / kBandRows;
+
+#ifdef _OPENMP
+#pragma omp parallel if((long)outRows * outCols >= kParallelPixels)
+#endif
+    {
+        Vector<unsigned short> coarseBuf(pw * 16);
+        Vector<unsigned short> fineBuf(pw * 256);
+        Vector<unsigned short> windowBuf(16 + 256);
+        Vector<unsigned char> outBuf(outCols);
+        unsigned short* colCoarse = &coarseBuf[0];
+        unsigned short* colFine = &fineBuf[0];
+        unsigned short* coarse = &windowBuf[0];
+        unsigned short* fine = coarse + 16;
+        unsigned char* out = &outBuf[0];
+
+#ifdef _OPENMP
+#pragma omp for
+#endif
+        for (int band = 0; band < bands; ++band) {
+            int first = band * kBandRows;
+            int last = std::min(first + kBandRows, outRows);
+
+            for (int k = 0; k < pw * 16; ++k) colCoarse[k] = 0;
+            for (int k = 0; k < pw * 256; ++k) colFine[k] = 0;
+            for (int y = first; y < first + size - 1; ++y) {
+                const unsigned char* row = padded + (long)y * pw;
+                for (int c = 0; c < pw; ++c) {
+                    ++colCoarse[c * 16 + (row[c] >> 4)];
+                    ++colFine[c * 256 + row[c]];
+                }
+            }
+
+            for (int i = first; i < last; ++i) {
+                const unsigned char* incoming = padded + (long)(i + size - 1) * pw;
+                for (int c = 0; c < pw; ++c) {
+                    ++colCoarse[c * 16 + (incoming[c] >> 4)];
+                    ++colFine[c * 256 + incoming[c]];
+                }
+                if (i > first) {
+                    const unsigned char* outgoing = padded + (long)(i - 1) * pw;
+                    for (int c = 0; c < pw; ++c) {
+                        --colCoarse[c * 16 + (outgoing[c] >> 4)];
+                        --colFine[c * 256 + outgoing[c]];
+                    }
+                }
+
+                // fineStart[b]: window start column the fine bins of bucket b describe
+                int fineStart[16];
+                for (int b = 0; b < 16; ++b) {
+                    coarse[b] = 0;
+                    fineStart[b] = -1;
+                }
+                for (int c = 0; c < size; ++c) {
+                    addCounts(coarse, colCoarse + c * 16);
+                }
+
+                for (int j = 0; j < outCols; ++j) {
+                    if (j > 0) {
+                        slideCounts(coarse, colCoarse + (j + size - 1) * 16, colCoarse + (j - 1) * 16);
+                    }
+
+                    int below = 0;
+                    int b = 0;
+                    while (below + coarse[b] <= rank) {
+                        below += coarse[b];
+                        ++b;
+                    }
+
+                    unsigned short* bins = fine + b * 16;
+                    if (fineStart[b] < 0 || j - fineStart[b] >= size) {
+                        for (int k = 0; k < 16; ++k) bins[k] = 0;
+                        for (int c = j; c < j + size; ++c) {
+                            addCounts(bins, colFine + c * 256 + b * 16);
+                        }
+                    } else {
+                        for (int s = fineStart[b]; s < j; ++s) {
+                            slideCounts(bins, colFine + (s + size) * 256 + b * 16, colFine + s * 256 + b * 16);
+                        }
+                    }
+                    fineStart[b] = j;
+
+                    int k = 0;
+                    while (below + bins[k] <= rank) {
+                        below += bins[k];
+                        ++k;
+                    }
+                    out[j] = (unsigned char)(b * 16 + k);
+                }
+                Convolution::storeRow(out, outCols, output.rowPtr(i));
+            }
+        }
+    }
+}
+
+MedianFilter::MedianFilter(int size) throw(int) : Convolution(), windowSize(3) {
+    setSize(size);
+}
+
+void MedianFilter::setSize(int size) throw(int) {
+    // Histogram counts are 16-bit, which bounds the window at 255 x 255
+    if (size < 1 || size > 255) throw -1;
+    windowSize = size;
+}
+
+Image MedianFilter::apply8Bit(const Vector<unsigned char>& pixels, int paddedRows, int paddedCols) const {
+    Image output(paddedRows - windowSize + 1, paddedCols - windowSize + 1);
+    if (windowSize == 3) {
+        median3x3(&pixels[0], paddedCols, output);
+    } else if (windowSize == 5) {
+        median5x5(&pixels[0], paddedCols, output);
+    } else {
+        medianHistogram(&pixels[0], paddedCols, windowSize, output);
+    }
+    return output;
+}
+
+// Any data and any stride: copy each window and select its median
+Image MedianFilter::applyGeneric(const ImageView& input) const {
+    int pad = (paddingMode == Padding_None) ? 0 : (windowSize - 1) / 2;
+    int pw = input.getCols() + 2 * pad;
+    int outRows = (input.getRows() + 2 * pad - windowSize) / stride + 1;
+    int outCols = (pw - windowSize) / stride + 1;
+    Image output(outRows, outCols);
+
+    Vector<double> paddedBuf;
+    padInput(input, pad, pad, paddingMode, paddedBuf);
+    const double* padded = &paddedBuf[0];
+    int taps = windowSize * windowSize;
+    int rank = (taps - 1) / 2;
+
+#ifdef _OPENMP
+#pragma omp parallel if((long)outRows * outCols * taps >= kParallelPixels)
+#endif
+    {
+        Vector<double> windowBuf(taps);
+        double* window = &windowBuf[0];
+
+#ifdef _OPENMP
+#pragma omp for
+#endif
+        for (int i = 0; i < outRows; ++i) {
+            double* dst = output.rowPtr(i);
+            for (int j = 0; j < outCols; ++j) {
+                const double* src = padded + (long)i * stride * pw + j * stride;
+                for (int m = 0; m < windowSize; ++m) {
+                    for (int n = 0; n < windowSize; ++n) {
+                        window[m * windowSize + n] = src[(long)m * pw + n];
+                    }
+                }
+                std::nth_element(window, window + rank, window + taps);
+                dst[j] = window[rank];
+            }
+        }
+    }
+    return output;
+}
+
+Image MedianFilter::apply(const ImageView& input) const {
+    int inRows = input.getRows();
+    int inCols = input.getCols();
+    int pad = (paddingMode == Padding_None) ? 0 : (windowSize - 1) / 2;
+    if (inRows + 2 * pad < windowSize || inCols + 2 * pad < windowSize) {
+        return Image(0, 0);
+    }
+
+    // A pending normalization rarely leaves integer pixels, so such input goes
+    // straight to the generic path (padInput applies the normalization)
+    if (stride == 1 && !input.hasPendingNormalization()) {
+        Vector<unsigned char> pixels;
+        if (padInput8Bit(input, pad, pad, paddingMode, pixels)) {
+            return apply8Bit(pixels, inRows + 2 * pad, inCols + 2 * pad);
+        }
+    }
+    return applyGeneric(input);
+}
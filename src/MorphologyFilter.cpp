@@ -0,0 +1,224 @@
+#include "MorphologyFilter.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// The two window operations, for single values and for SSE2 registers
+struct ErodeOp {
+    static inline unsigned char apply(unsigned char a, unsigned char b) { return a < b ? a : b; }
+    static inline double apply(double a, double b) { return a < b ? a : b; }
+#ifdef __SSE2__
+    static inline __m128i apply(__m128i a, __m128i b) { return _mm_min_epu8(a, b); }
+    static inline __m128d apply(__m128d a, __m128d b) { return _mm_min_pd(a, b); }
+#endif
+};
+
+struct DilateOp {
+    static inline unsigned char apply(unsigned char a, unsigned char b) { return a < b ? b : a; }
+    static inline double apply(double a, double b) { return a < b ? b : a; }
+#ifdef __SSE2__
+    static inline __m128i apply(__m128i a, __m128i b) { return _mm_max_epu8(a, b); }
+    static inline __m128d apply(__m128d a, __m128d b) { return _mm_max_pd(a, b); }
+#endif
+};
+
+// dst = op(a, b) element-wise over n values
+template <class Op>
+static inline void combineRows(const unsigned char* a, const unsigned char* b, int n, unsigned char* dst) {
+    int j = 0;
+#ifdef __SSE2__
+    for (; j + 16 <= n; j += 16) {
+        _mm_storeu_si128((__m128i*)(dst + j), Op::apply(_mm_loadu_si128((const __m128i*)(a + j)),
+                                                        _mm_loadu_si128((const __m128i*)(b + j))));
+    }
+#endif
+    for (; j < n; ++j) {
+        dst[j] = Op::apply(a[j], b[j]);
+    }
+}
+
+template <class Op>
+static inline void combineRows(const double* a, const double* b, int n, double* dst) {
+    int j = 0;
+#ifdef __SSE2__
+    for (; j + 2 <= n; j += 2) {
+        _mm_storeu_pd(dst + j, Op::apply(_mm_loadu_pd(a + j), _mm_loadu_pd(b + j)));
+    }
+#endif
+    for (; j < n; ++j) {
+        dst[j] = Op::apply(a[j], b[j]);
+    }
+}
+
+template <class T>
+static inline void copyRow(const T* src, int n, T* dst) {
+    for (int j = 0; j < n; ++j) {
+        dst[j] = src[j];
+    }
+}
+
+// Van Herk / Gil-Werman over whole rows: the padded rows are cut into blocks of
+// k. Output row j = op(suffix of j's block from j, prefix of the next block up to
+// j + k - 1), so each output row costs three row operations for any k.
+template <class T, class Op>
+static void verticalPass(const T* src, int pw, int ph, int k, T* dst) {
+    int outRows = ph - k + 1;
+    int blocks = (outRows + k - 1) / k;
+
+#ifdef _OPENMP
+#pragma omp parallel if((long)outRows * pw >= kParallelPixels)
+#endif
+    {
+        Vector<T> buf((k + 1) * pw);
+        T* suffix = &buf[0];
+        T* prefix = suffix + (long)k * pw;
+
+#ifdef _OPENMP
+#pragma omp for
+#endif
+        for (int b = 0; b < blocks; ++b) {
+            int first = b * k;
+            int count = (outRows - first < k) ? outRows - first : k;
+
+            copyRow(src + (long)(first + k - 1) * pw, pw, suffix + (long)(k - 1) * pw);
+            for (int t = k - 2; t >= 0; --t) {
+                combineRows<Op>(src + (long)(first + t) * pw, suffix + (long)(t + 1) * pw, pw,
+                                suffix + (long)t * pw);
+            }
+            copyRow(suffix, pw, dst + (long)first * pw);
+
+            for (int t = 1; t < count; ++t) {
+                const T* incoming = src + (long)(first + k - 1 + t) * pw;
+                if (t == 1) {
+                    copyRow(incoming, pw, prefix);
+                } else {
+                    combineRows<Op>(prefix, incoming, pw, prefix);
+                }
+                combineRows<Op>(suffix + (long)t * pw, prefix, pw, dst + (long)(first + t) * pw);
+            }
+        }
+    }
+}
+
+// Same decomposition along each row, written straight into the output image
+template <class T, class Op>
+static void horizontalPass(const T* src, int pw, int k, Image& output) {
+    int outRows = output.getRows();
+    int outCols = output.getCols();
+
+#ifdef _OPENMP
+#pragma omp parallel if((long)outRows * outCols >= kParallelPixels)
+#endif
+    {
+        Vector<T> buf(2 * pw + outCols);
+        T* prefix = &buf[0];
+        T* suffix = prefix + pw;
+        T* out = suffix + pw;
+
+#ifdef _OPENMP
+#pragma omp for
+#endif
+        for (int i = 0; i < outRows; ++i) {
+            const T* x = src + (long)i * pw;
+            for (int start = 0; start < pw; start += k) {
+                int end = (start + k < pw) ? start + k : pw;
+                prefix[start] = x[start];
+                for (int c = start + 1; c < end; ++c) {
+                    prefix[c] = Op::apply(prefix[c - 1], x[c]);
+                }
+                suffix[end - 1] = x[end - 1];
+                for (int c = end - 2; c >= start; --c) {
+                    suffix[c] = Op::apply(suffix[c + 1], x[c]);
+                }
+            }
+            for (int j = 0; j < outCols; ++j) {
+                out[j] = Op::apply(suffix[j], prefix[j + k - 1]);
+            }
+            Convolution::storeRow(out, outCols, output.rowPtr(i));
+        }
+    }
+}
+
+template <class T, class Op>
+static void separableMorphology(const T* padded, int pw, int ph, int width, int height, Image& output) {
+    Vector<T> columnBuf((ph - height + 1) * pw);
+    verticalPass<T, Op>(padded, pw, ph, height, &columnBuf[0]);
+    horizontalPass<T, Op>(&columnBuf[0], pw, width, output);
+}
+
+MorphologyFilter::MorphologyFilter(Operation op, int width, int height) throw(int)
+    : Convolution(), operation(op), elementWidth(3), elementHeight(3) {
+    setElementSize(width, height);
+}
+
+void MorphologyFilter::setOperation(Operation op) {
+    operation = op;
+}
+
+void MorphologyFilter::setElementSize(int width, int height) throw(int) {
+    if (width < 1 || height < 1) throw -1;
+    elementWidth = width;
+    elementHeight = height;
+}
+
+int MorphologyFilter::getRadius() const {
+    int k = elementWidth > elementHeight ? elementWidth : elementHeight;
+    bool single = (operation == Operation_Erode || operation == Operation_Dilate);
+    return single ? k / 2 : 2 * (k / 2);
+}
+
+Image MorphologyFilter::applyOnce(const ImageView& input, bool erode) const {
+    int padH = 0, padW = 0;
+    if (paddingMode != Padding_None) {
+        padH = (elementHeight - 1) / 2;
+        padW = (elementWidth - 1) / 2;
+    }
+    int ph = input.getRows() + 2 * padH;
+    int pw = input.getCols() + 2 * padW;
+    if (ph < elementHeight || pw < elementWidth) {
+        return Image(0, 0);
+    }
+    Image output(ph - elementHeight + 1, pw - elementWidth + 1);
+
+    // 8-bit (and binary 0/255) images run 16 pixels per SSE2 operation
+    Vector<unsigned char> pixels;
+    if (!input.hasPendingNormalization() && padInput8Bit(input, padH, padW, paddingMode, pixels)) {
+        if (erode) {
+            separableMorphology<unsigned char, ErodeOp>(&pixels[0], pw, ph, elementWidth, elementHeight, output);
+        } else {
+            separableMorphology<unsigned char, DilateOp>(&pixels[0], pw, ph, elementWidth, elementHeight, output);
+        }
+        return output;
+    }
+
+    Vector<double> padded;
+    padInput(input, padH, padW, paddingMode, padded);
+    if (erode) {
+        separableMorphology<double, ErodeOp>(&padded[0], pw, ph, elementWidth, elementHeight, output);
+    } else {
+        separableMorphology<double, DilateOp>(&padded[0], pw, ph, elementWidth, elementHeight, output);
+    }
+    return output;
+}
+
+Image MorphologyFilter::apply(const ImageView& input) const {
+    // Open erodes then dilates; close dilates then erodes
+    bool single = (operation == Operation_Erode || operation == Operation_Dilate);
+    Image dense = single ? applyOnce(input, operation == Operation_Erode)
+                         : applyOnce(applyOnce(input, operation == Operation_Open), operation == Operation_Close);
+    if (stride <= 1 || dense.getRows() == 0 || dense.getCols() == 0) {
+        return dense;
+    }
+
+    // Strided output samples the dense result, matching Convolution's output size
+    Image output((dense.getRows() - 1) / stride + 1, (dense.getCols() - 1) / stride + 1);
+    for (int i = 0; i < output.getRows(); ++i) {
+        const double* src = dense.rowPtr(i * stride);
+        double* dst = output.rowPtr(i);
+        for (int j = 0; j < output.getCols(); ++j) {
+            dst[j] = src[j * stride];
+        }
+    }
+    return output;
+}
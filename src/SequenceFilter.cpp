@@ -0,0 +1,148 @@
+#include "SequenceFilter.h"
+#include <cstring>
+
+SequenceFilter::SequenceFilter(const Convolution& f, int size) throw(int)
+    : filter(&f), tileSize(64), primed(false), changedTiles(0), tileCount(0) {
+    setTileSize(size);
+}
+
+void SequenceFilter::setTileSize(int size) throw(int) {
+    if (size < 1) throw -1;
+    tileSize = size;
+    primed = false;
+}
+
+void SequenceFilter::reset() {
+    primed = false;
+}
+
+// Row by row, each tile's segment is compared with the stored frame and copied
+// over it when it differs, so previous ends up holding the new frame. memcmp is
+// a bitwise compare, so -0.0 vs 0.0 counts as a change, which is harmless.
+int SequenceFilter::diffFrame(const ImageView& frame, int tilesX, Vector<unsigned char>& dirty) {
+    int rows = frame.getRows();
+    int cols = frame.getCols();
+    bool lazy = frame.hasPendingNormalization();
+    unsigned char* flags = &dirty[0];
+
+    for (int i = 0; i < rows; ++i) {
+        const double* src = frame.rowPtr(i);
+        double* dst = previous.rowPtr(i);
+        unsigned char* rowFlags = flags + (long)(i / tileSize) * tilesX;
+        for (int t = 0; t < tilesX; ++t) {
+            int c0 = t * tileSize;
+            int n = (cols - c0 < tileSize) ? cols - c0 : tileSize;
+            if (lazy) {
+                for (int j = c0; j < c0 + n; ++j) {
+                    double v = frame.normalizedValue(src[j]);
+                    if (v != dst[j]) {
+                        dst[j] = v;
+                        rowFlags[t] = 1;
+                    }
+                }
+            } else if (memcmp(src + c0, dst + c0, n * sizeof(double)) != 0) {
+                memcpy(dst + c0, src + c0, n * sizeof(double));
+                rowFlags[t] = 1;
+            }
+        }
+    }
+
+    int count = 0;
+    for (int k = 0; k < dirty.getsize(); ++k) {
+        count += flags[k];
+    }
+    return count;
+}
+
+// Output rectangle (x, y, w, h) is refiltered from the input grown by the
+// filter radius. Where that margin is cut by the view rather than the image
+// border the filter pads with made-up values, but those only reach the margin,
+// which is not copied back.
+void SequenceFilter::recomputeRegion(int x, int y, int w, int h) {
+    int rows = previous.getRows();
+    int cols = previous.getCols();
+    int radius = filter->getRadius();
+    int x0 = x - radius > 0 ? x - radius : 0;
+    int y0 = y - radius > 0 ? y - radius : 0;
+    int x1 = x + w + radius < cols ? x + w + radius : cols;
+    int y1 = y + h + radius < rows ? y + h + radius : rows;
+
+    Image region = filter->apply(ImageView(previous, x0, y0, x1 - x0, y1 - y0));
+    for (int i = 0; i < h; ++i) {
+        const double* src = region.rowPtr(y - y0 + i) + (x - x0);
+        double* dst = output.rowPtr(y + i) + x;
+        for (int j = 0; j < w; ++j) {
+            dst[j] = src[j];
+        }
+    }
+}
+
+void SequenceFilter::recomputeAll() {
+    output = filter->apply(previous);
+}
+
+const Image& SequenceFilter::process(const ImageView& frame) {
+    int rows = frame.getRows();
+    int cols = frame.getCols();
+    int tilesY = (rows + tileSize - 1) / tileSize;
+    int tilesX = (cols + tileSize - 1) / tileSize;
+    tileCount = tilesY * tilesX;
+
+    // Global filters (and output grids that are not the input grid) gain
+    // nothing from the cache. Locality is asked per frame because a filter may
+    // pick its path from the whole input.
+    if (!filter->isLocal(frame) || filter->getStride() != 1) {
+        primed = false;
+        changedTiles = tileCount;
+        output = filter->apply(frame);
+        return output;
+    }
+
+    if (!primed || previous.getRows() != rows || previous.getCols() != cols) {
+        previous = frame.materialize();
+        recomputeAll();
+        primed = (output.getRows() == rows && output.getCols() == cols);
+        changedTiles = tileCount;
+        return output;
+    }
+
+    Vector<unsigned char> dirty(tileCount > 0 ? tileCount : 1);
+    changedTiles = diffFrame(frame, tilesX, dirty);
+    if (changedTiles == 0) {
+        return output;
+    }
+    // Past about half the frame the overlapping halos cost more than one full pass
+    if (2 * changedTiles > tileCount) {
+        recomputeAll();
+        return output;
+    }
+
+    // Neighbouring changed tiles in a tile row share one refilter, so their
+    // common halo is computed once
+    int radius = filter->getRadius();
+    for (int ty = 0; ty < tilesY; ++ty) {
+        const unsigned char* rowFlags = &dirty[0] + (long)ty * tilesX;
+        int tx = 0;
+        while (tx < tilesX) {
+            if (!rowFlags[tx]) {
+                ++tx;
+                continue;
+            }
+            int first = tx;
+            while (tx < tilesX && rowFlags[tx]) {
+                ++tx;
+            }
+            // Outputs within the radius of a changed pixel change too
+            int x0 = first * tileSize - radius;
+            int y0 = ty * tileSize - radius;
+            int x1 = tx * tileSize + radius;
+            int y1 = (ty + 1) * tileSize + radius;
+            if (x0 < 0) x0 = 0;
+            if (y0 < 0) y0 = 0;
+            if (x1 > cols) x1 = cols;
+            if (y1 > rows) y1 = rows;
+            recomputeRegion(x0, y0, x1 - x0, y1 - y0);
+        }
+    }
+    return output;
+}
@@ -1,67 +1,654 @@
 #include "SobelDetector.h"
+#include <cfloat>
 #include <cmath>
 
-SobelDetector::SobelDetector() : Convolution(), useThreshold(false), thresholdValue(0.0), invertOutput(false) {
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Histogram bins for the automatic threshold on non-8-bit input
+static const int kAutoThresholdBins = 1024;
+
+// Largest 8-bit Sobel response is 4 * 255 per axis, so |G|^2 <= 2 * 1020^2.
+static const int kMaxAxisResponse = 1020;
+static const int kMaxSquaredMagnitude = 2 * kMaxAxisResponse * kMaxAxisResponse;
+
+// Largest integer s with sqrt(s) <= t, so that "sqrt(s) > t" becomes "s > limit"
+// with exactly the same outcome as the floating-point comparison.
+static int squaredThresholdLimit(double t) {
+    if (t < 0) return -1;
+    if (t * t > kMaxSquaredMagnitude) return kMaxSquaredMagnitude;
+    int s = (int)(t * t);
+    while (s > 0 && sqrt((double)s) > t) --s;
+    while (sqrt((double)(s + 1)) <= t) ++s;
+    return s;
+}
+
+// Integer limit for the value the 8-bit path compares against the threshold.
+static int integerThresholdLimit(double t, SobelDetector::MagnitudeMode mode) {
+    if (mode == SobelDetector::Magnitude_L2) return squaredThresholdLimit(t);
+    int maxValue = (mode == SobelDetector::Magnitude_L1) ? 2 * kMaxAxisResponse : kMaxAxisResponse;
+    if (t < 0) return -1;
+    if (t >= maxValue) return maxValue;
+    return (int)t;
+}
+
+// Gradient magnitude for one output row; r0..r2 are the three padded input rows.
+// L2 yields |Gx|^2 + |Gy|^2 (the square root is left to the caller).
+static void gradientRow(const unsigned char* r0, const unsigned char* r1, const unsigned char* r2,
+                        int cols, SobelDetector::MagnitudeMode mode, int* out) {
+    int j = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    for (; j + 8 <= cols; j += 8) {
+        __m128i a0 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(r0 + j)), zero);
+        __m128i a1 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(r0 + j + 1)), zero);
+        __m128i a2 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(r0 + j + 2)), zero);
+        __m128i b0 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(r1 + j)), zero);
+        __m128i b2 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(r1 + j + 2)), zero);
+        __m128i c0 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(r2 + j)), zero);
+        __m128i c1 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(r2 + j + 1)), zero);
+        __m128i c2 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(r2 + j + 2)), zero);
+
+        // Gx = (a2 - a0) + 2 (b2 - b0) + (c2 - c0)
+        __m128i db = _mm_sub_epi16(b2, b0);
+        __m128i gx = _mm_add_epi16(_mm_add_epi16(_mm_sub_epi16(a2, a0), _mm_sub_epi16(c2, c0)),
+                                   _mm_add_epi16(db, db));
+        // Gy = (c0 + 2 c1 + c2) - (a0 + 2 a1 + a2)
+        __m128i gy = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(c0, c2), _mm_add_epi16(c1, c1)),
+                                   _mm_add_epi16(_mm_add_epi16(a0, a2), _mm_add_epi16(a1, a1)));
+
+        if (mode == SobelDetector::Magnitude_L2) {
+            // Interleave (gx, gy) pairs so madd yields gx^2 + gy^2 in each 32-bit lane
+            __m128i lo = _mm_unpacklo_epi16(gx, gy);
+            __m128i hi = _mm_unpackhi_epi16(gx, gy);
+            _mm_storeu_si128((__m128i*)(out + j), _mm_madd_epi16(lo, lo));
+            _mm_storeu_si128((__m128i*)(out + j + 4), _mm_madd_epi16(hi, hi));
+        } else {
+            __m128i ax = _mm_max_epi16(gx, _mm_sub_epi16(zero, gx));
+            __m128i ay = _mm_max_epi16(gy, _mm_sub_epi16(zero, gy));
+            __m128i m = (mode == SobelDetector::Magnitude_L1) ? _mm_add_epi16(ax, ay) : _mm_max_epi16(ax, ay);
+            _mm_storeu_si128((__m128i*)(out + j), _mm_unpacklo_epi16(m, zero));
+            _mm_storeu_si128((__m128i*)(out + j + 4), _mm_unpackhi_epi16(m, zero));
+        }
+    }
+#endif
+    for (; j < cols; ++j) {
+        int gx = (r0[j + 2] - r0[j]) + 2 * (r1[j + 2] - r1[j]) + (r2[j + 2] - r2[j]);
+        int gy = (r2[j] + 2 * r2[j + 1] + r2[j + 2]) - (r0[j] + 2 * r0[j + 1] + r0[j + 2]);
+        if (mode == SobelDetector::Magnitude_L2) {
+            out[j] = gx * gx + gy * gy;
+        } else {
+            int ax = gx < 0 ? -gx : gx;
+            int ay = gy < 0 ? -gy : gy;
+            out[j] = (mode == SobelDetector::Magnitude_L1) ? ax + ay : (ax > ay ? ax : ay);
+        }
+    }
+}
+
+// Maps squared magnitudes to the 0-255 values savePGM would write for
+// sqrt(mag2) (or 255 - sqrt(mag2) when inverting), without calling sqrt in double.
+static void quantizeSquaredRow(const int* mag2, int cols, bool invert, int* out) {
+    int j = 0;
+#ifdef __SSE2__
+    // Everything at or above 255^2 saturates, and below it float sqrt is exact
+    // enough that truncation gives floor(sqrt(n)).
+    const __m128i cap = _mm_set1_epi32(255 * 255);
+    const __m128i base = _mm_set1_epi32(254);
+    for (; j + 4 <= cols; j += 4) {
+        __m128i n = _mm_loadu_si128((const __m128i*)(mag2 + j));
+        __m128i over = _mm_cmpgt_epi32(n, cap);
+        n = _mm_or_si128(_mm_and_si128(over, cap), _mm_andnot_si128(over, n));
+        __m128 f = _mm_cvtepi32_ps(n);
+        __m128i r = _mm_cvttps_epi32(_mm_sqrt_ps(f));
+        if (invert) {
+            __m128 rf = _mm_cvtepi32_ps(r);
+            __m128i exact = _mm_castps_si128(_mm_cmpeq_ps(_mm_mul_ps(rf, rf), f));
+            // 255 - r on perfect squares, otherwise 254 - r (truncation of 255 - sqrt(n))
+            r = _mm_sub_epi32(_mm_sub_epi32(base, r), exact);
+        }
+        _mm_storeu_si128((__m128i*)(out + j), r);
+    }
+#endif
+    for (; j < cols; ++j) {
+        int n = mag2[j] > 255 * 255 ? 255 * 255 : mag2[j];
+        int r = (int)sqrt((double)n);
+        if (invert) {
+            r = (r * r == n) ? 255 - r : 254 - r;
+        }
+        out[j] = r;
+    }
+}
+
+// Integer magnitudes (L1 / max-norm) only need clamping.
+static void quantizeLinearRow(const int* mag, int cols, bool invert, int* out) {
+    for (int j = 0; j < cols; ++j) {
+        int v = mag[j] > 255 ? 255 : mag[j];
+        out[j] = invert ? 255 - v : v;
+    }
+}
+
+// Double-precision magnitude for one row; L2 with 'squared' skips the sqrt.
+static void magnitudeRow(const double* gx, const double* gy, int cols,
+                         SobelDetector::MagnitudeMode mode, bool squared, double* out) {
+    int j = 0;
+#ifdef __SSE2__
+    const __m128d signMask = _mm_set1_pd(-0.0);
+    for (; j + 2 <= cols; j += 2) {
+        __m128d x = _mm_loadu_pd(gx + j);
+        __m128d y = _mm_loadu_pd(gy + j);
+        __m128d m;
+        if (mode == SobelDetector::Magnitude_L2) {
+            m = _mm_add_pd(_mm_mul_pd(x, x), _mm_mul_pd(y, y));
+            if (!squared) m = _mm_sqrt_pd(m);
+        } else {
+            x = _mm_andnot_pd(signMask, x);
+            y = _mm_andnot_pd(signMask, y);
+            m = (mode == SobelDetector::Magnitude_L1) ? _mm_add_pd(x, y) : _mm_max_pd(x, y);
+        }
+        _mm_storeu_pd(out + j, m);
+    }
+#endif
+    for (; j < cols; ++j) {
+        double x = gx[j];
+        double y = gy[j];
+        if (mode == SobelDetector::Magnitude_L2) {
+            double m = x * x + y * y;
+            out[j] = squared ? m : sqrt(m);
+        } else {
+            x = fabs(x);
+            y = fabs(y);
+            out[j] = (mode == SobelDetector::Magnitude_L1) ? x + y : (x > y ? x : y);
+        }
+    }
+}
+
+// Histogram level of an 8-bit magnitude: the smallest integer T with magnitude <= T,
+// so "level > T" is exactly "magnitude > T". L2 gets ceil(sqrt(|G|^2)).
+static int levelCount(SobelDetector::MagnitudeMode mode) {
+    if (mode == SobelDetector::Magnitude_L2) return 1444;  // ceil(sqrt(kMaxSquaredMagnitude)) + 1
+    return (mode == SobelDetector::Magnitude_L1) ? 2 * kMaxAxisResponse + 1 : kMaxAxisResponse + 1;
+}
+
+static void magnitudeLevelRow(const int* mag, int cols, SobelDetector::MagnitudeMode mode, unsigned short* level) {
+    if (mode != SobelDetector::Magnitude_L2) {
+        for (int j = 0; j < cols; ++j) {
+            level[j] = (unsigned short)mag[j];
+        }
+        return;
+    }
+    int j = 0;
+#ifdef __SSE2__
+    // |G|^2 < 2^24 and its root < 2^11, so the float products below are exact and
+    // one correction step each way turns the truncated root into floor(sqrt(n))
+    const __m128 one = _mm_set1_ps(1.0f);
+    for (; j + 4 <= cols; j += 4) {
+        __m128 n = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(mag + j)));
+        __m128 r = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_sqrt_ps(n)));
+        r = _mm_sub_ps(r, _mm_and_ps(_mm_cmpgt_ps(_mm_mul_ps(r, r), n), one));
+        __m128 next = _mm_add_ps(r, one);
+        r = _mm_add_ps(r, _mm_and_ps(_mm_cmple_ps(_mm_mul_ps(next, next), n), one));
+        r = _mm_add_ps(r, _mm_and_ps(_mm_cmplt_ps(_mm_mul_ps(r, r), n), one));
+        __m128i v = _mm_cvttps_epi32(r);
+        _mm_storel_epi64((__m128i*)(level + j), _mm_packs_epi32(v, v));
+    }
+#endif
+    for (; j < cols; ++j) {
+        int n = mag[j];
+        int r = (int)sqrt((double)n);
+        if (r * r > n) --r;
+        if ((r + 1) * (r + 1) <= n) ++r;
+        level[j] = (unsigned short)(r * r < n ? r + 1 : r);
+    }
+}
+
+// Otsu's method: the level T that maximizes the between-class variance of
+// {level <= T} and {level > T}
+static int otsuLevel(const Vector<long>& hist) {
+    int bins = hist.getsize();
+    double total = 0.0, weightedTotal = 0.0;
+    for (int b = 0; b < bins; ++b) {
+        total += hist[b];
+        weightedTotal += (double)b * hist[b];
+    }
+
+    int best = 0;
+    double bestVariance = -1.0;
+    double below = 0.0, weightedBelow = 0.0;
+    for (int t = 0; t < bins; ++t) {
+        below += hist[t];
+        weightedBelow += (double)t * hist[t];
+        double above = total - below;
+        if (below == 0.0) continue;
+        if (above == 0.0) break;
+        double diff = weightedBelow / below - (weightedTotal - weightedBelow) / above;
+        double variance = below * above * diff * diff;
+        if (variance > bestVariance) {
+            bestVariance = variance;
+            best = t;
+        }
+    }
+    return best;
+}
+
+// Magnitude histogram whose bin width w = 2^shift grows as larger values arrive,
+// so the range never has to be found in a pass of its own. Bin b holds
+// ((b - 1) w, b w] and bin 0 holds 0; doubling w maps b to ceil(b / 2) exactly,
+// so thread histograms with different widths merge onto the widest losslessly.
+class AdaptiveHistogram {
+private:
+    Vector<long> bins;
+    int shift;
+    bool ranged;        // false while only zeros have been seen
+    double scale;       // 1 / w
+
+    void widenTo(int newShift) {
+        int d = newShift - shift;
+        if (d <= 0) return;
+        long* p = &bins[0];
+        // Targets are never above their source, so an ascending sweep folds in place
+        for (int b = 1; b < bins.getsize(); ++b) {
+            int target = d >= 16 ? 1 : (b + (1 << d) - 1) >> d;
+            long v = p[b];
+            p[b] = 0;
+            p[target] += v;
+        }
+        shift = newShift;
+        scale = ldexp(1.0, -shift);
+    }
+
+    // Smallest w with value / w <= top
+    void fit(double value) {
+        int e;
+        frexp(value / (bins.getsize() - 1), &e);
+        if (!ranged) {
+            ranged = true;
+            shift = e;
+            scale = ldexp(1.0, -shift);
+        } else {
+            widenTo(e);
+        }
+    }
+
+public:
+    explicit AdaptiveHistogram(int count) : bins(count), shift(0), ranged(false), scale(0.0) {}
+
+    double getScale() const { return scale; }
+    const Vector<long>& getBins() const { return bins; }
+
+    void add(double value) {
+        int top = bins.getsize() - 1;
+        double level = ceil(value * scale);
+        if ((level > top || (!ranged && value > 0.0)) && value <= DBL_MAX) {
+            fit(value);
+            level = ceil(value * scale);
+        }
+        ++bins[level < top ? (int)level : top];   // NaN and infinity count as the top bin
+    }
+
+    void merge(AdaptiveHistogram& other) {
+        if (other.ranged) {
+            if (!ranged) {
+                ranged = true;
+                shift = other.shift;
+                scale = other.scale;
+            }
+            widenTo(other.shift);
+            other.widenTo(shift);
+        }
+        for (int b = 0; b < bins.getsize(); ++b) {
+            bins[b] += other.bins[b];
+        }
+    }
+};
+
+static FilterBank createGradientBank() {
+    FilterBank bank;
+    bank.addKernel(Convolution::createSobelXKernel());
+    bank.addKernel(Convolution::createSobelYKernel());
+    return bank;
+}
+
+// The Sobel kernels never change, so the bank is built once per process
+const FilterBank& SobelDetector::gradientBank() {
+    static const FilterBank bank = createGradientBank();
+    return bank;
+}
+
+SobelDetector::SobelDetector() : Convolution(), useThreshold(false), useAutoThreshold(false), thresholdValue(0.0),
+                                 invertOutput(false),
+                                 useFixedPoint(false), magnitudeMode(Magnitude_L2) {
     // SobelDetector doesn't use the base 'kernel' member for the main operation,
     // but we initialize the base class anyway.
 }
 
 void SobelDetector::setThreshold(double t) {
     useThreshold = true;
+    useAutoThreshold = false;
     thresholdValue = t;
 }
 
+void SobelDetector::setAutoThreshold() {
+    useThreshold = false;
+    useAutoThreshold = true;
+}
+
 void SobelDetector::disableThreshold() {
     useThreshold = false;
+    useAutoThreshold = false;
 }
 
 void SobelDetector::setInvert(bool inv) {
     invertOutput = inv;
 }
 
-Image SobelDetector::apply(const Image& input) const {
-    // Create Gx and Gy kernels
-    Matrix kx = Convolution::createSobelXKernel();
-    Matrix ky = Convolution::createSobelYKernel();
+void SobelDetector::setFixedPoint(bool enable) {
+    useFixedPoint = enable;
+}
 
-    // Create Convolution objects for X and Y
-    // We use the padding mode set in this SobelDetector instance (inherited from Convolution)
-    Convolution convX(kx, 1, paddingMode);
-    Convolution convY(ky, 1, paddingMode);
+void SobelDetector::setMagnitudeMode(MagnitudeMode mode) {
+    magnitudeMode = mode;
+}
 
-    // Apply convolutions
-    Image gx = convX.apply(input);
-    Image gy = convY.apply(input);
+Image SobelDetector::autoThresholdFixedPoint(const Vector<unsigned char>& pixels, int rows, int cols, int pw,
+                                             double* usedThreshold) const {
+    const unsigned char* buf = &pixels[0];
+    int bins = levelCount(magnitudeMode);
+    Vector<unsigned short> levelBuf(rows * cols);
+    unsigned short* levels = &levelBuf[0];
+    Vector<long> hist(bins);
 
-    // Result image
+    // Magnitude pass with the histogram fused in; each thread counts privately
+#ifdef _OPENMP
+#pragma omp parallel if((long)rows * cols >= kParallelPixels)
+#endif
+    {
+        Vector<int> magBuf(cols);
+        Vector<long> localBuf(bins);
+        int* mag = &magBuf[0];
+        long* local = &localBuf[0];
+
+#ifdef _OPENMP
+#pragma omp for
+#endif
+        for (int i = 0; i < rows; ++i) {
+            const unsigned char* r0 = buf + i * pw;
+            unsigned short* level = levels + (long)i * cols;
+            gradientRow(r0, r0 + pw, r0 + 2 * pw, cols, magnitudeMode, mag);
+            magnitudeLevelRow(mag, cols, magnitudeMode, level);
+            for (int j = 0; j < cols; ++j) {
+                ++local[level[j]];
+            }
+        }
+
+#ifdef _OPENMP
+#pragma omp critical(sobel_histogram)
+#endif
+        for (int b = 0; b < bins; ++b) {
+            hist[b] += local[b];
+        }
+    }
+
+    int t = otsuLevel(hist);
+    if (usedThreshold) *usedThreshold = t;
+
+    Image result(rows, cols);
+    double edge = invertOutput ? 0.0 : 255.0;
+#ifdef _OPENMP
+#pragma omp parallel for if((long)rows * cols >= kParallelPixels)
+#endif
+    for (int i = 0; i < rows; ++i) {
+        const unsigned short* level = levels + (long)i * cols;
+        double* dst = result.rowPtr(i);
+        for (int j = 0; j < cols; ++j) {
+            dst[j] = level[j] > t ? edge : 255.0 - edge;
+        }
+    }
+    return result;
+}
+
+Image SobelDetector::applyFixedPoint(const Vector<unsigned char>& pixels, int inRows, int inCols,
+                                     double* usedThreshold) const {
+    int pad = (paddingMode == Padding_None) ? 0 : 1;
+    int pw = inCols + 2 * pad;
+    int rows = inRows + 2 * pad - 2;
+    int cols = inCols + 2 * pad - 2;
+    if (rows <= 0 || cols <= 0) {
+        return Image(0, 0);
+    }
+    if (useAutoThreshold) {
+        return autoThresholdFixedPoint(pixels, rows, cols, pw, usedThreshold);
+    }
+
+    Image result(rows, cols);
+    Vector<int> magBuf(cols);
+    Vector<int> outBuf(cols);
+    int* mag = &magBuf[0];
+    int* out = &outBuf[0];
+    const unsigned char* buf = &pixels[0];
+
+    int limit = integerThresholdLimit(thresholdValue, magnitudeMode);
+    int edge = invertOutput ? 0 : 255;
+
+    for (int i = 0; i < rows; ++i) {
+        const unsigned char* r0 = buf + i * pw;
+        gradientRow(r0, r0 + pw, r0 + 2 * pw, cols, magnitudeMode, mag);
+
+        if (useThreshold) {
+            for (int j = 0; j < cols; ++j) {
+                out[j] = mag[j] > limit ? edge : 255 - edge;
+            }
+        } else if (magnitudeMode == Magnitude_L2) {
+            quantizeSquaredRow(mag, cols, invertOutput, out);
+        } else {
+            quantizeLinearRow(mag, cols, invertOutput, out);
+        }
+
+        double* dst = result.rowPtr(i);
+        for (int j = 0; j < cols; ++j) {
+            dst[j] = (double)out[j];
+        }
+    }
+    return result;
+}
+
+// Levels are magnitudes scaled so that bound maps to the last bin; the threshold is
+// applied as "scaled magnitude > T", i.e. magnitude > T / scale
+Image SobelDetector::autoThreshold(const Image& gx, const Image& gy, double* usedThreshold) const {
     int rows = gx.getRows();
     int cols = gx.getCols();
     Image result(rows, cols);
+    AdaptiveHistogram hist(kAutoThresholdBins);
+
+#ifdef _OPENMP
+#pragma omp parallel if((long)rows * cols >= kParallelPixels)
+#endif
+    {
+        AdaptiveHistogram local(kAutoThresholdBins);
 
+#ifdef _OPENMP
+#pragma omp for
+#endif
+        for (int i = 0; i < rows; ++i) {
+            double* dst = result.rowPtr(i);
+            magnitudeRow(gx.rowPtr(i), gy.rowPtr(i), cols, magnitudeMode, false, dst);
+            for (int j = 0; j < cols; ++j) {
+                local.add(dst[j]);
+            }
+        }
+
+#ifdef _OPENMP
+#pragma omp critical(sobel_histogram)
+#endif
+        hist.merge(local);
+    }
+
+    int t = otsuLevel(hist.getBins());
+    double scale = hist.getScale();
+    if (usedThreshold) *usedThreshold = (scale > 0.0) ? t / scale : 0.0;
+
+    // Binarize in place
+    double edge = invertOutput ? 0.0 : 255.0;
+#ifdef _OPENMP
+#pragma omp parallel for if((long)rows * cols >= kParallelPixels)
+#endif
     for (int i = 0; i < rows; ++i) {
+        double* dst = result.rowPtr(i);
         for (int j = 0; j < cols; ++j) {
-            double valX = gx.getElement(i, j);
-            double valY = gy.getElement(i, j);
-            
-            // Calculate magnitude
-            double magnitude = sqrt(valX * valX + valY * valY);
-
-            // Apply threshold if enabled
-            if (useThreshold) {
-                if (magnitude > thresholdValue) {
-                    magnitude = 255.0;
-                } else {
-                    magnitude = 0.0;
-                }
+            dst[j] = dst[j] * scale > t ? edge : 255.0 - edge;
+        }
+    }
+    return result;
+}
+
+BitMask SobelDetector::packFixedPoint(const Vector<unsigned char>& pixels, int inRows, int inCols) const {
+    int pad = (paddingMode == Padding_None) ? 0 : 1;
+    int pw = inCols + 2 * pad;
+    int rows = inRows + 2 * pad - 2;
+    int cols = inCols + 2 * pad - 2;
+    if (rows <= 0 || cols <= 0) {
+        return BitMask(0, 0);
+    }
+
+    BitMask mask(rows, cols);
+    const unsigned char* buf = &pixels[0];
+    int limit = integerThresholdLimit(thresholdValue, magnitudeMode);
+    // Set bits mean "output 255": edges normally, background when inverted
+    uint64_t flip = invertOutput ? ~(uint64_t)0 : 0;
+    int tailBits = cols % 64;
+    uint64_t tail = tailBits == 0 ? ~(uint64_t)0 : (((uint64_t)1 << tailBits) - 1);
+
+#ifdef _OPENMP
+#pragma omp parallel if((long)rows * cols >= kParallelPixels)
+#endif
+    {
+        Vector<int> magBuf(mask.getWordsPerRow() * 64);
+        int* mag = &magBuf[0];
+
+#ifdef _OPENMP
+#pragma omp for
+#endif
+        for (int i = 0; i < rows; ++i) {
+            const unsigned char* r0 = buf + i * pw;
+            gradientRow(r0, r0 + pw, r0 + 2 * pw, cols, magnitudeMode, mag);
+            for (int j = cols; j < mask.getWordsPerRow() * 64; ++j) {
+                mag[j] = limit;   // padding bits compare false
             }
 
-            // Apply inversion
-            if (invertOutput) {
-                magnitude = 255.0 - magnitude;
-                if (magnitude < 0) magnitude = 0; // Safety clamp
+            uint64_t* dst = mask.rowWords(i);
+            for (int w = 0; w < mask.getWordsPerRow(); ++w) {
+                const int* m = mag + w * 64;
+                uint64_t bits = 0;
+#ifdef __SSE2__
+                const __m128i t = _mm_set1_epi32(limit);
+                for (int k = 0; k < 64; k += 16) {
+                    __m128i a = _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i*)(m + k)), t);
+                    __m128i b = _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i*)(m + k + 4)), t);
+                    __m128i c = _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i*)(m + k + 8)), t);
+                    __m128i d = _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i*)(m + k + 12)), t);
+                    __m128i packed = _mm_packs_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+                    bits |= (uint64_t)(unsigned)_mm_movemask_epi8(packed) << k;
+                }
+#else
+                for (int k = 0; k < 64; ++k) {
+                    if (m[k] > limit) bits |= (uint64_t)1 << k;
+                }
+#endif
+                dst[w] = bits ^ flip;
             }
+            dst[mask.getWordsPerRow() - 1] &= tail;
+        }
+    }
+    return mask;
+}
+
+BitMask SobelDetector::applyMask(const ImageView& input, double* usedThreshold) const throw(int) {
+    if (!useThreshold && !useAutoThreshold) throw -1;
+
+    // Fixed threshold on 8-bit input never materializes the 0/255 image
+    if (useThreshold && !input.hasPendingNormalization() && input.getRows() > 0 && input.getCols() > 0) {
+        Vector<unsigned char> pixels;
+        int pad = (paddingMode == Padding_None) ? 0 : 1;
+        if (padInput8Bit(input, pad, pad, paddingMode, pixels)) {
+            if (usedThreshold) *usedThreshold = thresholdValue;
+            return packFixedPoint(pixels, input.getRows(), input.getCols());
+        }
+    }
+    return BitMask::fromImage(apply(input, usedThreshold));
+}
+
+bool SobelDetector::isLocal(const ImageView& input) const {
+    if (useAutoThreshold) return false;
+    // With a threshold both paths give the same 0/255 result
+    if (useFixedPoint && !useThreshold) return is8Bit(input);
+    return true;
+}
+
+Image SobelDetector::apply(const ImageView& input) const {
+    return apply(input, 0);
+}
 
-            result.setElement(i, j, magnitude);
+Image SobelDetector::apply(const ImageView& input, double* usedThreshold) const {
+    // The magnitude is not linear in the input, so a pending normalization is applied first
+    if (input.hasPendingNormalization()) {
+        Image normalized = input.materialize();
+        return apply(normalized, usedThreshold);
+    }
+    if (usedThreshold) *usedThreshold = useThreshold ? thresholdValue : -1.0;
+
+    // Exact integer path: thresholded output is identical by construction, and
+    // plain magnitudes match what savePGM writes once fixed point is requested.
+    if ((useThreshold || useAutoThreshold || useFixedPoint) && input.getRows() > 0 && input.getCols() > 0) {
+        Vector<unsigned char> pixels;
+        int pad = (paddingMode == Padding_None) ? 0 : 1;
+        if (padInput8Bit(input, pad, pad, paddingMode, pixels)) {
+            return applyFixedPoint(pixels, input.getRows(), input.getCols(), usedThreshold);
+        }
+    }
+
+    // Gx and Gy in one pass, with the padding mode set in this SobelDetector instance
+    // (inherited from Convolution)
+    Image gradients[2];
+    gradientBank().apply(input, gradients, 1, paddingMode);
+    const Image& gx = gradients[0];
+    const Image& gy = gradients[1];
+
+    if (useAutoThreshold) {
+        return autoThreshold(gx, gy, usedThreshold);
+    }
+
+    // Result image
+    int rows = gx.getRows();
+    int cols = gx.getCols();
+    Image result(rows, cols);
+
+    // L2 thresholding compares squared values; only magnitudes within rounding
+    // distance of t^2 fall back to sqrt so the outcome matches sqrt(m) > t exactly.
+    bool squaredCompare = useThreshold && magnitudeMode == Magnitude_L2;
+    double t = thresholdValue;
+    double lowSq = (t < 0) ? -1.0 : t * t * (1.0 - 1e-12);
+    double highSq = (t < 0) ? -1.0 : t * t * (1.0 + 1e-12);
+    double edge = invertOutput ? 0.0 : 255.0;
+
+    for (int i = 0; i < rows; ++i) {
+        double* dst = result.rowPtr(i);
+        magnitudeRow(gx.rowPtr(i), gy.rowPtr(i), cols, magnitudeMode, squaredCompare, dst);
+
+        if (squaredCompare) {
+            for (int j = 0; j < cols; ++j) {
+                double m2 = dst[j];
+                bool isEdge = m2 > highSq || (m2 > lowSq && sqrt(m2) > t);
+                dst[j] = isEdge ? edge : 255.0 - edge;
+            }
+        } else if (useThreshold) {
+            for (int j = 0; j < cols; ++j) {
+                dst[j] = dst[j] > t ? edge : 255.0 - edge;
+            }
+        } else if (invertOutput) {
+            for (int j = 0; j < cols; ++j) {
+                double v = 255.0 - dst[j];
+                dst[j] = v < 0 ? 0 : v; // Safety clamp
+            }
         }
     }
 
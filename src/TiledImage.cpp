@@ -0,0 +1,449 @@
+#include "TiledImage.h"
+
+static const char kMagic[4] = { 'M', 'C', 'T', 'I' };
+static const unsigned int kVersion = 1;
+static const int kHeaderBytes = 32;
+static const int kIndexEntryBytes = 16;
+// Largest buffer (index, band or tile) held in memory at once
+static const unsigned int kMaxBytes = 0x7FFFFFFFU;
+static const unsigned int kFlagChecksums = 1;
+
+// Fixed little-endian fields, so files move between hosts unchanged
+static void putU32(unsigned char* p, unsigned int v) {
+    for (int k = 0; k < 4; ++k) {
+        p[k] = (unsigned char)(v >> (8 * k));
+    }
+}
+
+static unsigned int getU32(const unsigned char* p) {
+    unsigned int v = 0;
+    for (int k = 3; k >= 0; --k) {
+        v = (v << 8) | p[k];
+    }
+    return v;
+}
+
+static void putU64(unsigned char* p, uint64_t v) {
+    putU32(p, (unsigned int)(v & 0xFFFFFFFFUL));
+    putU32(p + 4, (unsigned int)(v >> 32));
+}
+
+static uint64_t getU64(const unsigned char* p) {
+    return ((uint64_t)getU32(p + 4) << 32) | getU32(p);
+}
+
+// Adler-32 as in zlib; the sums are reduced every 5552 bytes, the most that
+// cannot overflow 32 bits
+static unsigned int adler32(const unsigned char* data, long n) {
+    unsigned long a = 1, b = 0;
+    while (n > 0) {
+        long chunk = n < 5552 ? n : 5552;
+        n -= chunk;
+        for (long k = 0; k < chunk; ++k) {
+            a += data[k];
+            b += a;
+        }
+        data += chunk;
+        a %= 65521;
+        b %= 65521;
+    }
+    return (unsigned int)((b << 16) | a);
+}
+
+static unsigned char quantize(double v) {
+    int pixel = (int)v;
+    if (pixel < 0) pixel = 0;
+    if (pixel > 255) pixel = 255;
+    return (unsigned char)pixel;
+}
+
+static void skipPGMComments(ifstream& file) {
+    while (true) {
+        file >> ws;
+        if (file.peek() == '#') {
+            file.ignore(65536, '\n');
+        } else {
+            break;
+        }
+    }
+}
+
+// Hands the writer the image one band of rows at a time, so a PGM never has to
+// be held in memory as a whole
+class RowSource {
+public:
+    virtual ~RowSource() {}
+    // Next count rows, width bytes each
+    virtual bool readRows(int count, unsigned char* dst) = 0;
+};
+
+class ViewRowSource : public RowSource {
+private:
+    const ImageView& view;
+    int next;
+
+public:
+    explicit ViewRowSource(const ImageView& v) : view(v), next(0) {}
+
+    virtual bool readRows(int count, unsigned char* dst) {
+        int cols = view.getCols();
+        bool lazy = view.hasPendingNormalization();
+        for (int i = 0; i < count; ++i, ++next) {
+            const double* src = view.rowPtr(next);
+            unsigned char* row = dst + (long)i * cols;
+            for (int j = 0; j < cols; ++j) {
+                row[j] = quantize(lazy ? view.normalizedValue(src[j]) : src[j]);
+            }
+        }
+        return true;
+    }
+};
+
+class PGMRowSource : public RowSource {
+private:
+    ifstream& file;
+    bool ascii;
+    int width;
+
+public:
+    PGMRowSource(ifstream& f, bool isAscii, int w) : file(f), ascii(isAscii), width(w) {}
+
+    virtual bool readRows(int count, unsigned char* dst) {
+        long n = (long)count * width;
+        if (!ascii) {
+            file.read((char*)dst, n);
+            return file.gcount() == n;
+        }
+        for (long k = 0; k < n; ++k) {
+            int val;
+            if (!(file >> val)) return false;
+            dst[k] = quantize(val);
+        }
+        return true;
+    }
+};
+
+// Tiles go out band by band behind a zeroed index, which is filled in at the end.
+// The index, one band and one tile are held in memory, so each must fit an int
+// byte count.
+static bool writeTiled(RowSource& source, int width, int height, const string& filename, int tileW, int tileH,
+                       bool checksums) {
+    int tilesX = (int)(((long)width + tileW - 1) / tileW);
+    int tilesY = (int)(((long)height + tileH - 1) / tileH);
+    uint64_t tiles = (uint64_t)tilesX * tilesY;
+    int bandH = tileH < height ? tileH : height;
+    int maxTileCols = tileW < width ? tileW : width;
+    if (tiles * kIndexEntryBytes > (uint64_t)kMaxBytes || (uint64_t)bandH * width > (uint64_t)kMaxBytes) {
+        return false;
+    }
+
+    ofstream out(filename.c_str(), ios::binary);
+    if (!out) return false;
+
+    unsigned char header[kHeaderBytes] = { 0 };
+    for (int k = 0; k < 4; ++k) {
+        header[k] = (unsigned char)kMagic[k];
+    }
+    putU32(header + 4, kVersion);
+    putU32(header + 8, (unsigned int)width);
+    putU32(header + 12, (unsigned int)height);
+    putU32(header + 16, (unsigned int)tileW);
+    putU32(header + 20, (unsigned int)tileH);
+    putU32(header + 24, checksums ? kFlagChecksums : 0);
+    out.write((const char*)header, kHeaderBytes);
+
+    int indexBytes = (int)tiles * kIndexEntryBytes;
+    Vector<unsigned char> index(indexBytes > 0 ? indexBytes : 1);
+    out.write((const char*)&index[0], indexBytes);
+
+    Vector<unsigned char> band(bandH * width > 0 ? bandH * width : 1);
+    Vector<unsigned char> tile(bandH * maxTileCols > 0 ? bandH * maxTileCols : 1);
+    uint64_t offset = kHeaderBytes + (uint64_t)tiles * kIndexEntryBytes;
+    for (int ty = 0; ty < tilesY; ++ty) {
+        int bandRows = (height - ty * tileH < tileH) ? height - ty * tileH : tileH;
+        if (!source.readRows(bandRows, &band[0])) return false;
+
+        for (int tx = 0; tx < tilesX; ++tx) {
+            int c0 = tx * tileW;
+            int tileCols = (width - c0 < tileW) ? width - c0 : tileW;
+            for (int i = 0; i < bandRows; ++i) {
+                const unsigned char* src = &band[0] + (long)i * width + c0;
+                unsigned char* dst = &tile[0] + i * tileCols;
+                for (int j = 0; j < tileCols; ++j) {
+                    dst[j] = src[j];
+                }
+            }
+            unsigned int bytes = (unsigned int)(bandRows * tileCols);
+            unsigned char* entry = &index[0] + ((long)ty * tilesX + tx) * kIndexEntryBytes;
+            putU64(entry, offset);
+            putU32(entry + 8, bytes);
+            putU32(entry + 12, checksums ? adler32(&tile[0], bytes) : 0);
+            out.write((const char*)&tile[0], bytes);
+            offset += bytes;
+        }
+    }
+
+    if (tiles > 0) {
+        out.seekp(kHeaderBytes);
+        out.write((const char*)&index[0], indexBytes);
+    }
+    out.close();
+    return !out.fail();
+}
+
+TiledImage::TiledImage()
+    : width(0), height(0), tileWidth(0), tileHeight(0), tilesX(0), tilesY(0), hasChecksums(false) {}
+
+bool TiledImage::open(const string& filename) {
+    close();
+    file.open(filename.c_str(), ios::binary);
+    if (!file) return false;
+
+    // Counts in the header are untrusted: the index and every tile must fit in the file
+    file.seekg(0, ios::end);
+    streamoff fileSize = file.tellg();
+    file.seekg(0, ios::beg);
+
+    unsigned char header[kHeaderBytes];
+    if (fileSize < kHeaderBytes || !file.read((char*)header, kHeaderBytes)) {
+        close();
+        return false;
+    }
+    for (int k = 0; k < 4; ++k) {
+        if (header[k] != (unsigned char)kMagic[k]) {
+            close();
+            return false;
+        }
+    }
+    unsigned int w = getU32(header + 8);
+    unsigned int h = getU32(header + 12);
+    unsigned int tw = getU32(header + 16);
+    unsigned int th = getU32(header + 20);
+    const unsigned int kMaxSide = 0x7FFFFFFFU;
+    if (getU32(header + 4) != kVersion || w > kMaxSide || h > kMaxSide || tw < 1 || th < 1 ||
+        tw > kMaxSide || th > kMaxSide) {
+        close();
+        return false;
+    }
+
+    uint64_t tileCount = (uint64_t)((w + tw - 1) / tw) * ((h + th - 1) / th);
+    uint64_t tileBytes = (uint64_t)(tw < w ? tw : w) * (th < h ? th : h);
+    // toPGM holds a full-width band of tiles, the same limit writeTiled applies
+    uint64_t bandBytes = (uint64_t)w * (th < h ? th : h);
+    uint64_t available = (uint64_t)(fileSize - kHeaderBytes);
+    if (tileCount > available / kIndexEntryBytes || tileCount * kIndexEntryBytes > kMaxBytes ||
+        (tileCount > 0 && tileBytes > available - tileCount * kIndexEntryBytes) || tileBytes > kMaxBytes ||
+        bandBytes > kMaxBytes) {
+        close();
+        return false;
+    }
+
+    width = (int)w;
+    height = (int)h;
+    tileWidth = (int)tw;
+    tileHeight = (int)th;
+    tilesX = (int)((w + tw - 1) / tw);
+    tilesY = (int)((h + th - 1) / th);
+    hasChecksums = (getU32(header + 24) & kFlagChecksums) != 0;
+
+    int tiles = tilesX * tilesY;
+    tileOffsets.resize(tiles);
+    tileSizes.resize(tiles);
+    tileChecksums.resize(tiles);
+    if (tiles > 0) {
+        Vector<unsigned char> index(tiles * kIndexEntryBytes);
+        if (!file.read((char*)&index[0], (long)tiles * kIndexEntryBytes)) {
+            close();
+            return false;
+        }
+        for (int t = 0; t < tiles; ++t) {
+            const unsigned char* entry = &index[0] + (long)t * kIndexEntryBytes;
+            tileOffsets[t] = getU64(entry);
+            tileSizes[t] = getU32(entry + 8);
+            tileChecksums[t] = getU32(entry + 12);
+        }
+    }
+    return true;
+}
+
+void TiledImage::close() {
+    if (file.is_open()) file.close();
+    file.clear();
+    width = height = tileWidth = tileHeight = tilesX = tilesY = 0;
+    hasChecksums = false;
+}
+
+bool TiledImage::readBytes(int x, int y, int w, int h, Vector<unsigned char>& out) {
+    if (w <= 0 || h <= 0) {
+        out.resize(0);
+        return true;
+    }
+    // The region is held in one buffer, so it must fit an int byte count
+    uint64_t regionBytes = (uint64_t)w * h;
+    if (regionBytes > kMaxBytes) return false;
+    out.resize((int)regionBytes);
+
+    // open() bounded the largest tile; edge tiles are smaller
+    int tileW = tileWidth < width ? tileWidth : width;
+    int tileH = tileHeight < height ? tileHeight : height;
+    Vector<unsigned char> tile(tileW * tileH);
+    for (int ty = y / tileHeight; ty <= (y + h - 1) / tileHeight; ++ty) {
+        int r0 = ty * tileHeight;
+        int tileRows = (height - r0 < tileHeight) ? height - r0 : tileHeight;
+        for (int tx = x / tileWidth; tx <= (x + w - 1) / tileWidth; ++tx) {
+            int c0 = tx * tileWidth;
+            int tileCols = (width - c0 < tileWidth) ? width - c0 : tileWidth;
+            int t = ty * tilesX + tx;
+            unsigned int bytes = tileSizes[t];
+            if (bytes != (unsigned int)(tileRows * tileCols)) return false;
+
+            file.clear();
+            file.seekg((streamoff)tileOffsets[t]);
+            if (!file.read((char*)&tile[0], bytes)) return false;
+            if (hasChecksums && adler32(&tile[0], bytes) != tileChecksums[t]) return false;
+
+            // Part of this tile inside the region
+            int i0 = (y > r0) ? y - r0 : 0;
+            int i1 = (y + h < r0 + tileRows) ? y + h - r0 : tileRows;
+            int j0 = (x > c0) ? x - c0 : 0;
+            int j1 = (x + w < c0 + tileCols) ? x + w - c0 : tileCols;
+            for (int i = i0; i < i1; ++i) {
+                const unsigned char* src = &tile[0] + i * tileCols;
+                unsigned char* dst = &out[0] + (long)(r0 + i - y) * w + (c0 - x);
+                for (int j = j0; j < j1; ++j) {
+                    dst[j] = src[j];
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool TiledImage::readRegion(int x, int y, int w, int h, Image& out) throw(int) {
+    int roiX, roiY;
+    return readRegion(x, y, w, h, 0, out, roiX, roiY);
+}
+
+bool TiledImage::readRegion(int x, int y, int w, int h, int halo, Image& out, int& roiX, int& roiY) throw(int) {
+    if (x < 0 || y < 0 || x > width || y > height || halo < 0) throw -1;
+    if (!file.is_open()) return false;
+    if (w > width - x) w = width - x;
+    if (h > height - y) h = height - y;
+    roiX = roiY = 0;
+    if (w <= 0 || h <= 0) {
+        out = Image();
+        return true;
+    }
+
+    int x0 = (x - halo > 0) ? x - halo : 0;
+    int y0 = (y - halo > 0) ? y - halo : 0;
+    int x1 = (x + w + halo < width) ? x + w + halo : width;
+    int y1 = (y + h + halo < height) ? y + h + halo : height;
+    roiX = x - x0;
+    roiY = y - y0;
+
+    Vector<unsigned char> pixels;
+    if (!readBytes(x0, y0, x1 - x0, y1 - y0, pixels)) return false;
+
+    // Size in place; assigning a fresh Image would copy it once more
+    out = Image();
+    out.resize(y1 - y0, x1 - x0);
+    for (int i = 0; i < y1 - y0; ++i) {
+        const unsigned char* src = &pixels[0] + (long)i * (x1 - x0);
+        double* dst = out.rowPtr(i);
+        for (int j = 0; j < x1 - x0; ++j) {
+            dst[j] = (double)src[j];
+        }
+    }
+    return true;
+}
+
+bool TiledImage::applyToRegion(const Convolution& filter, int x, int y, int w, int h, Image& out) throw(int) {
+    if (filter.getStride() != 1 || filter.getPadding() == Convolution::Padding_None) {
+        throw -1;
+    }
+    if (x < 0 || y < 0 || x > width || y > height) throw -1;
+    if (w > width - x) w = width - x;
+    if (h > height - y) h = height - y;
+
+    Image region;
+    int roiX, roiY;
+    if (!readRegion(x, y, w, h, filter.getRadius(), region, roiX, roiY)) return false;
+    // Tiles hold 8-bit pixels, so the region answers locality for the whole image
+    if (!filter.isLocal(region)) throw -1;
+    if (w <= 0 || h <= 0) {
+        out = Image();
+        return true;
+    }
+
+    // Inside the image the halo supplies the real neighbours; at its border the
+    // region ends where the image does, so the filter pads exactly as for the whole image
+    Image filtered = filter.apply(region);
+    if (filtered.getRows() != region.getRows() || filtered.getCols() != region.getCols()) throw -1;
+
+    out = Image();
+    out.resize(h, w);
+    for (int i = 0; i < h; ++i) {
+        const double* src = filtered.rowPtr(roiY + i) + roiX;
+        double* dst = out.rowPtr(i);
+        for (int j = 0; j < w; ++j) {
+            dst[j] = src[j];
+        }
+    }
+    return true;
+}
+
+bool TiledImage::save(const ImageView& image, const string& filename, int tileW, int tileH, bool checksums) throw(int) {
+    if (tileW < 1 || tileH < 1) throw -1;
+    ViewRowSource source(image);
+    return writeTiled(source, image.getCols(), image.getRows(), filename, tileW, tileH, checksums);
+}
+
+bool TiledImage::fromPGM(const string& pgmFile, const string& tiledFile, int tileW, int tileH,
+                         bool checksums) throw(int) {
+    if (tileW < 1 || tileH < 1) throw -1;
+    ifstream file(pgmFile.c_str(), ios::binary);
+    if (!file) return false;
+
+    string format;
+    file >> format;
+    if (format != "P2" && format != "P5") return false;
+
+    int w, h, maxVal;
+    skipPGMComments(file);
+    file >> w;
+    skipPGMComments(file);
+    file >> h;
+    skipPGMComments(file);
+    file >> maxVal;
+    if (file.fail() || w < 0 || h < 0 || maxVal < 1 || maxVal > 255) return false;
+    // Exactly one whitespace byte separates maxVal from P5 data
+    int c = file.get();
+    if (c == '\r' && file.peek() == '\n') {
+        file.get();
+    }
+
+    PGMRowSource source(file, format == "P2", w);
+    return writeTiled(source, w, h, tiledFile, tileW, tileH, checksums);
+}
+
+bool TiledImage::toPGM(const string& tiledFile, const string& pgmFile) {
+    TiledImage tiled;
+    if (!tiled.open(tiledFile)) return false;
+
+    ofstream out(pgmFile.c_str(), ios::binary);
+    if (!out) return false;
+    out << "P5\n" << tiled.width << " " << tiled.height << "\n255\n";
+
+    // open() rejected files whose band exceeds kMaxBytes, so each band fits readBytes
+    Vector<unsigned char> band;
+    for (int y = 0; y < tiled.height; y += tiled.tileHeight) {
+        int rows = (tiled.height - y < tiled.tileHeight) ? tiled.height - y : tiled.tileHeight;
+        if (!tiled.readBytes(0, y, tiled.width, rows, band)) return false;
+        if (tiled.width > 0) {
+            out.write((const char*)&band[0], (long)rows * tiled.width);
+        }
+    }
+    out.close();
+    return !out.fail();
+}
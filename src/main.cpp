@@ -1,11 +1,24 @@
 #include <iostream>
 #include <cstdlib>
+#include <cstdio>
+#include <fstream>
 #include <string>
+#include <ctime>
+#include <cmath>
+#include <algorithm>
 #include "Vector.h"
 #include "Matrix.h"
 #include "Image.h"
 #include "Convolution.h"
 #include "SobelDetector.h"
+#include "BitMask.h"
+#include "SequenceFilter.h"
+#include "MedianFilter.h"
+#include "TiledImage.h"
+#include "FilterBank.h"
+#include "MorphologyFilter.h"
+#include "Autotuner.h"
+#include "ImagePyramid.h"
 
 using namespace std;
 
@@ -46,6 +59,691 @@ void testMatrixExceptions() {
     }
 }
 
+// 两幅图像的最大逐像素差（尺寸不同时返回 -1）
+static double maxDifference(const Image& a, const Image& b) {
+    if (a.getRows() != b.getRows() || a.getCols() != b.getCols()) return -1.0;
+    double worst = 0.0;
+    for (int i = 0; i < a.getRows(); ++i) {
+        for (int j = 0; j < a.getCols(); ++j) {
+            double d = fabs(a.getElement(i, j) - b.getElement(i, j));
+            if (d > worst) worst = d;
+        }
+    }
+    return worst;
+}
+
+static void reportMatch(const char* name, double worst, double tolerance) {
+    cout << name << ": ";
+    if (worst >= 0.0 && worst <= tolerance) {
+        cout << "PASSED (max diff " << worst << ")" << endl;
+    } else {
+        cout << "FAILED (max diff " << worst << ")" << endl;
+    }
+}
+
+void testSequenceFilter() {
+    cout << "\n=== SequenceFilter Test ===" << endl;
+
+    // 定点 Sobel：某一帧出现非整数像素时，8 位路径与 double 路径不能在同一帧内混用
+    SobelDetector sobel;
+    sobel.setFixedPoint(true);
+    Image frame(150, 170);
+    for (int i = 0; i < frame.getRows(); ++i) {
+        for (int j = 0; j < frame.getCols(); ++j) {
+            frame.setElement(i, j, (double)((i * 37 + j * 11 + (i * j) % 7) % 256));
+        }
+    }
+
+    int tileSizes[] = { 8, 32, 64 };
+    double worst = 0.0;
+    for (int t = 0; t < 3; ++t) {
+        SequenceFilter sequence(sobel, tileSizes[t]);
+        Image current = frame;
+        for (int step = 0; step < 6; ++step) {
+            if (step == 2) current.setElement(70, 90, 100.5);          // 非 8 位帧
+            if (step == 4) current.setElement(70, 90, 101.0);          // 恢复为 8 位
+            if (step > 0) current.setElement(10 + 20 * step, 15, 255.0); // 小范围变化
+            double d = maxDifference(sequence.process(current), sobel.apply(current));
+            if (d < 0.0 || d > worst) worst = (d < 0.0) ? 1e9 : d;
+        }
+    }
+    reportMatch("[Test 1] Fixed-point Sobel, frame with a non-integer pixel", worst, 0.0);
+
+    SobelDetector thresholded;
+    thresholded.setThreshold(80);
+    thresholded.setPadding(Convolution::Padding_Replicate);
+    SequenceFilter sequence(thresholded, 16);
+    Image current = frame;
+    worst = 0.0;
+    for (int step = 0; step < 8; ++step) {
+        current.setElement((step * 29) % 150, (step * 53) % 170, (double)((step * 97) % 256));
+        double d = maxDifference(sequence.process(current), thresholded.apply(current));
+        if (d < 0.0 || d > worst) worst = (d < 0.0) ? 1e9 : d;
+    }
+    reportMatch("[Test 2] Thresholded Sobel, incremental vs full", worst, 0.0);
+}
+
+// 伪随机 8 位测试图像：平滑的渐变加上椒盐噪声，同一 seed 结果相同
+static Image makeTestImage(int rows, int cols, unsigned int seed) {
+    Image img(rows, cols);
+    unsigned int state = seed;
+    for (int i = 0; i < rows; ++i) {
+        for (int j = 0; j < cols; ++j) {
+            state = state * 1103515245u + 12345u;
+            int noise = (int)((state >> 16) % 100);
+            double v = (double)((i * 5 + j * 3) % 256);
+            if (noise < 5) v = 0.0;
+            else if (noise < 10) v = 255.0;
+            else if (noise < 40) v = (double)((state >> 8) % 256);
+            img.setElement(i, j, v);
+        }
+    }
+    return img;
+}
+
+// 按 savePGM 的规则量化（截断并钳位到 0-255）
+static Image quantized(const Image& img) {
+    Image out(img.getRows(), img.getCols());
+    for (int i = 0; i < img.getRows(); ++i) {
+        for (int j = 0; j < img.getCols(); ++j) {
+            int pixel = (int)img.getElement(i, j);
+            if (pixel < 0) pixel = 0;
+            if (pixel > 255) pixel = 255;
+            out.setElement(i, j, (double)pixel);
+        }
+    }
+    return out;
+}
+
+void testSobelFixedPoint() {
+    cout << "\n=== Sobel Fixed-Point Test ===" << endl;
+
+    // 奇数尺寸覆盖 SIMD 循环的尾部
+    Image img = makeTestImage(67, 93, 1);
+    SobelDetector::MagnitudeMode modes[] = { SobelDetector::Magnitude_L2, SobelDetector::Magnitude_L1,
+                                             SobelDetector::Magnitude_Max };
+    Convolution::PaddingMode paddings[] = { Convolution::Padding_Zero, Convolution::Padding_Replicate,
+                                            Convolution::Padding_None };
+
+    // 幅值：定点输出与 double 输出量化后逐位一致
+    double worst = 0.0;
+    for (int m = 0; m < 3; ++m) {
+        for (int p = 0; p < 3; ++p) {
+            for (int inv = 0; inv < 2; ++inv) {
+                SobelDetector exact;
+                exact.setMagnitudeMode(modes[m]);
+                exact.setPadding(paddings[p]);
+                exact.setInvert(inv == 1);
+                SobelDetector fixed = exact;
+                fixed.setFixedPoint(true);
+                double d = maxDifference(fixed.apply(img), quantized(exact.apply(img)));
+                if (d < 0.0 || d > worst) worst = (d < 0.0) ? 1e9 : d;
+            }
+        }
+    }
+    reportMatch("[Test 1] Magnitude, fixed point vs quantized double", worst, 0.0);
+
+    // 阈值（8 位输入总是走整数路径）：与 double 幅值 > t 的判定一致，位掩码与图像输出一致
+    double thresholds[] = { 0.0, 99.5, 100.0, 254.9, 1000.0 };
+    worst = 0.0;
+    double maskWorst = 0.0;
+    for (int m = 0; m < 3; ++m) {
+        SobelDetector magnitude;
+        magnitude.setMagnitudeMode(modes[m]);
+        Image reference = magnitude.apply(img);
+        for (int k = 0; k < 5; ++k) {
+            SobelDetector thresholded = magnitude;
+            thresholded.setThreshold(thresholds[k]);
+            Image expected(reference.getRows(), reference.getCols());
+            for (int i = 0; i < expected.getRows(); ++i) {
+                for (int j = 0; j < expected.getCols(); ++j) {
+                    expected.setElement(i, j, reference.getElement(i, j) > thresholds[k] ? 255.0 : 0.0);
+                }
+            }
+            Image out = thresholded.apply(img);
+            double d = maxDifference(out, expected);
+            if (d < 0.0 || d > worst) worst = (d < 0.0) ? 1e9 : d;
+            d = maxDifference(thresholded.applyMask(img).toImage(), out);
+            if (d < 0.0 || d > maskWorst) maskWorst = (d < 0.0) ? 1e9 : d;
+        }
+    }
+    reportMatch("[Test 2] Threshold, integer compare vs double magnitude", worst, 0.0);
+    reportMatch("[Test 3] Threshold, bit mask vs image output", maskWorst, 0.0);
+}
+
+static Image scaledBy(const Image& img, double factor) {
+    Image out(img.getRows(), img.getCols());
+    for (int i = 0; i < img.getRows(); ++i) {
+        for (int j = 0; j < img.getCols(); ++j) {
+            out.setElement(i, j, img.getElement(i, j) * factor);
+        }
+    }
+    return out;
+}
+
+// 无填充的中值滤波参考实现：逐窗口 nth_element 取较低的中值
+static Image bruteForceMedian(const Image& img, int size) {
+    int outRows = img.getRows() - size + 1;
+    int outCols = img.getCols() - size + 1;
+    Image out(outRows > 0 ? outRows : 0, outCols > 0 ? outCols : 0);
+    Vector<double> window(size * size);
+    double* w = &window[0];
+    for (int i = 0; i < out.getRows(); ++i) {
+        for (int j = 0; j < out.getCols(); ++j) {
+            for (int m = 0; m < size; ++m) {
+                for (int n = 0; n < size; ++n) {
+                    w[m * size + n] = img.getElement(i + m, j + n);
+                }
+            }
+            int mid = (size * size - 1) / 2;
+            nth_element(w, w + mid, w + size * size);
+            out.setElement(i, j, w[mid]);
+        }
+    }
+    return out;
+}
+
+void testMedianFilter() {
+    cout << "\n=== Median Filter Test ===" << endl;
+
+    // 足够大以进入并行的行带划分；3 为列排序合并，5 为排序网络，其余为直方图
+    Image img = makeTestImage(261, 259, 2);
+    int sizes[] = { 3, 5, 7, 9, 15 };
+
+    double worst = 0.0;
+    for (int s = 0; s < 5; ++s) {
+        MedianFilter median(sizes[s]);
+        median.setPadding(Convolution::Padding_None);
+        double d = maxDifference(median.apply(img), bruteForceMedian(img, sizes[s]));
+        if (d < 0.0 || d > worst) worst = (d < 0.0) ? 1e9 : d;
+    }
+    reportMatch("[Test 1] 8-bit paths vs brute force (3, 5, 7, 9, 15)", worst, 0.0);
+
+    // 有填充时与逐像素选择的通用路径比较：输入乘 1.5 后不再是 8 位整数，
+    // 零填充与复制填充都与缩放可交换（且乘 1.5 是精确的），8 位路径的结果乘 1.5 应与之一致
+    Image scaled = scaledBy(img, 1.5);
+    int paddedSizes[] = { 3, 4, 5, 8, 11 };
+    Convolution::PaddingMode paddings[] = { Convolution::Padding_Zero, Convolution::Padding_Replicate };
+    worst = 0.0;
+    for (int s = 0; s < 5; ++s) {
+        for (int p = 0; p < 2; ++p) {
+            MedianFilter median(paddedSizes[s]);
+            median.setPadding(paddings[p]);
+            double d = maxDifference(scaledBy(median.apply(img), 1.5), median.apply(scaled));
+            if (d < 0.0 || d > worst) worst = (d < 0.0) ? 1e9 : d;
+        }
+    }
+    reportMatch("[Test 2] Padded 8-bit paths vs generic selection (3, 4, 5, 8, 11)", worst, 0.0);
+}
+
+// 全卷积的逐项参考实现
+static Vector<double> naiveConvolve(const Vector<double>& a, const Vector<double>& b) {
+    int n = a.getsize();
+    int m = b.getsize();
+    Vector<double> out(n + m - 1);
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < m; ++j) {
+            out[i + j] += a[i] * b[j];
+        }
+    }
+    return out;
+}
+
+// 两个向量的最大逐项差（长度不同时返回 -1）
+static double maxDifference(const Vector<double>& a, const Vector<double>& b) {
+    if (a.getsize() != b.getsize()) return -1.0;
+    double worst = 0.0;
+    for (int i = 0; i < a.getsize(); ++i) {
+        double d = fabs(a[i] - b[i]);
+        if (d > worst) worst = d;
+    }
+    return worst;
+}
+
+static Vector<double> makeSignal(int n, unsigned int seed) {
+    Vector<double> v(n);
+    unsigned int state = seed;
+    for (int i = 0; i < n; ++i) {
+        state = state * 1103515245u + 12345u;
+        v[i] = (double)((state >> 8) % 2001) / 1000.0 - 1.0;
+    }
+    return v;
+}
+
+void testVectorConvolve() {
+    cout << "\n=== Vector Convolution Test ===" << endl;
+
+    // 与 numpy.convolve / numpy.correlate 的三种模式对照
+    double a[] = { 1.0, 2.0, 3.0 };
+    double b[] = { 0.0, 1.0, 0.5 };
+    double full[] = { 0.0, 1.0, 2.5, 4.0, 1.5 };
+    double same[] = { 1.0, 2.5, 4.0 };
+    double valid[] = { 2.5 };
+    double correlated[] = { 0.5, 2.0, 3.5, 3.0, 0.0 };
+    Vector<double> va(3, a);
+    Vector<double> vb(3, b);
+    double worst = 0.0;
+    double d[4];
+    d[0] = maxDifference(va.convolve(vb), Vector<double>(5, full));
+    d[1] = maxDifference(va.convolve(vb, Convolve_Same), Vector<double>(3, same));
+    d[2] = maxDifference(vb.convolve(va, Convolve_Valid), Vector<double>(1, valid));
+    d[3] = maxDifference(va.correlate(vb), Vector<double>(5, correlated));
+    for (int k = 0; k < 4; ++k) {
+        if (d[k] < 0.0 || d[k] > worst) worst = (d[k] < 0.0) ? 1e9 : d[k];
+    }
+    reportMatch("[Test 1] Full / same / valid / correlate vs numpy", worst, 0.0);
+
+    // 短核走 SIMD 直接法，长核走 FFT；奇数长度覆盖 SIMD 尾部，也覆盖核比信号长的情况
+    int lengths[][2] = { { 1001, 7 }, { 333, 64 }, { 5000, 400 }, { 4097, 1500 }, { 300, 2500 } };
+    worst = 0.0;
+    for (int k = 0; k < 5; ++k) {
+        Vector<double> signal = makeSignal(lengths[k][0], 3 + k);
+        Vector<double> kernel = makeSignal(lengths[k][1], 11 + k);
+        double diff = maxDifference(signal.convolve(kernel), naiveConvolve(signal, kernel));
+        if (diff < 0.0 || diff > worst) worst = (diff < 0.0) ? 1e9 : diff;
+    }
+    reportMatch("[Test 2] Direct and FFT kernels vs naive sum", worst, 1e-9);
+}
+
+static unsigned int readU32(const unsigned char* p) {
+    return (unsigned int)p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+void testTiledImage() {
+    cout << "\n=== Tiled Image Test ===" << endl;
+    const string tiledFile = "tiled_test.mcti";
+    const string pgmFile = "tiled_test.pgm";
+
+    // 块尺寸不整除图像，右/下边缘为残块
+    Image img = makeTestImage(203, 157, 4);
+    bool ok = TiledImage::save(img, tiledFile, 32, 24);
+    TiledImage tiled;
+    ok = ok && tiled.open(tiledFile);
+    Image whole;
+    ok = ok && tiled.readRegion(0, 0, img.getCols(), img.getRows(), whole);
+    double worst = ok ? maxDifference(whole, img) : 1e9;
+    reportMatch("[Test 1] Save and read back", worst, 0.0);
+
+    // 跨越多个块的区域、超出右/下边界的区域、带半径的局部滤波
+    Image region;
+    ok = tiled.readRegion(45, 30, 70, 500, region);
+    worst = ok ? maxDifference(region, img.crop(45, 30, 70, 173)) : 1e9;
+    SobelDetector sobel;
+    sobel.setPadding(Convolution::Padding_Replicate);
+    Image filtered;
+    ok = tiled.applyToRegion(sobel, 100, 50, 40, 60, filtered);
+    double d = ok ? maxDifference(filtered, sobel.apply(img).crop(100, 50, 40, 60)) : 1e9;
+    if (d < 0.0 || d > worst) worst = (d < 0.0) ? 1e9 : d;
+    reportMatch("[Test 2] Region reads and filtering vs full image", worst, 0.0);
+    tiled.close();
+
+    // PGM 往返
+    ok = TiledImage::toPGM(tiledFile, pgmFile) && TiledImage::fromPGM(pgmFile, tiledFile, 64, 64) &&
+         tiled.open(tiledFile) && tiled.readRegion(0, 0, img.getCols(), img.getRows(), whole);
+    worst = ok ? maxDifference(whole, img) : 1e9;
+    reportMatch("[Test 3] PGM round trip", worst, 0.0);
+    tiled.close();
+
+    // 单块文件的校验和即整块像素的 Adler-32："Wikipedia" 为 0x11E60398
+    const char* text = "Wikipedia";
+    Image word(1, 9);
+    for (int j = 0; j < 9; ++j) {
+        word.setElement(0, j, (double)(unsigned char)text[j]);
+    }
+    unsigned char entry[16] = { 0 };
+    if (TiledImage::save(word, tiledFile, 16, 16)) {
+        ifstream in(tiledFile.c_str(), ios::binary);
+        in.seekg(32);
+        in.read((char*)entry, 16);
+    }
+    cout << "[Test 4] Adler-32 of \"Wikipedia\": ";
+    cout << (readU32(entry + 12) == 0x11E60398u ? "PASSED" : "FAILED") << endl;
+
+    // 改动一个像素字节后校验失败
+    TiledImage::save(img, tiledFile, 32, 24);
+    {
+        fstream io(tiledFile.c_str(), ios::in | ios::out | ios::binary);
+        io.seekp(-1, ios::end);
+        io.put((char)(img.getElement(img.getRows() - 1, img.getCols() - 1) + 1));
+    }
+    bool detected = tiled.open(tiledFile) && !tiled.readRegion(150, 200, 7, 3, region);
+    tiled.close();
+    cout << "[Test 5] Corrupted tile is rejected: " << (detected ? "PASSED" : "FAILED") << endl;
+
+    // 文件头声明的块数远超文件长度时拒绝打开，不按声明分配索引
+    {
+        unsigned char header[32] = { 'M', 'C', 'T', 'I', 1 };
+        unsigned int fields[] = { 0x7FFFFFFFu, 0x7FFFFFFFu, 1, 1 };
+        for (int k = 0; k < 4; ++k) {
+            for (int b = 0; b < 4; ++b) {
+                header[8 + 4 * k + b] = (unsigned char)(fields[k] >> (8 * b));
+            }
+        }
+        ofstream out(tiledFile.c_str(), ios::binary);
+        out.write((const char*)header, 32);
+        out.write((const char*)entry, 16);
+    }
+    cout << "[Test 6] Oversized tile count is rejected: " << (tiled.open(tiledFile) ? "FAILED" : "PASSED") << endl;
+
+    remove(tiledFile.c_str());
+    remove(pgmFile.c_str());
+}
+
+void testFilterBank() {
+    cout << "\n=== Filter Bank Test ===" << endl;
+
+    Image img = makeTestImage(83, 101, 5);
+    // 3/5/7 步长 1 在 Auto 下走展开的定长路径；4x4 与步长 2 走逐邻域路径
+    int sizes[] = { 3, 5, 7, 4, 3 };
+    int strides[] = { 1, 1, 1, 1, 2 };
+    int counts[] = { 2, 9, 5, 3, 4 };
+    FilterBank::Method methods[] = { FilterBank::Method_Auto, FilterBank::Method_Neighbourhood,
+                                     FilterBank::Method_Im2col };
+    Convolution::PaddingMode paddings[] = { Convolution::Padding_Zero, Convolution::Padding_Replicate,
+                                            Convolution::Padding_None };
+    unsigned int state = 7;
+
+    double worst[3] = { 0.0, 0.0, 0.0 };
+    for (int c = 0; c < 5; ++c) {
+        int k = sizes[c];
+        Matrix* kernels = new Matrix[counts[c]];
+        for (int f = 0; f < counts[c]; ++f) {
+            kernels[f] = Matrix(k, k);
+            for (int t = 0; t < k * k; ++t) {
+                state = state * 1103515245u + 12345u;
+                kernels[f].setElement(t / k, t % k, (double)((int)((state >> 8) % 201) - 100) / 37.0);
+            }
+        }
+        for (int p = 0; p < 3; ++p) {
+            for (int m = 0; m < 3; ++m) {
+                FilterBank bank(strides[c], paddings[p]);
+                bank.setMethod(methods[m]);
+                for (int f = 0; f < counts[c]; ++f) {
+                    bank.addKernel(kernels[f]);
+                }
+                Image* outputs = new Image[counts[c]];
+                bank.apply(img, outputs);
+                for (int f = 0; f < counts[c]; ++f) {
+                    Convolution conv(kernels[f], strides[c], paddings[p]);
+                    double d = maxDifference(outputs[f], conv.apply(img));
+                    if (d < 0.0 || d > worst[m]) worst[m] = (d < 0.0) ? 1e9 : d;
+                }
+                delete[] outputs;
+            }
+        }
+        delete[] kernels;
+    }
+    reportMatch("[Test 1] Auto vs separate Convolution::apply", worst[0], 1e-9);
+    reportMatch("[Test 2] Neighbourhood vs separate Convolution::apply", worst[1], 1e-9);
+    reportMatch("[Test 3] Im2col vs separate Convolution::apply", worst[2], 1e-9);
+}
+
+// 逐窗口求最小/最大值的形态学参考实现（填充规则与 Convolution 相同）
+static Image bruteForceMorphology(const Image& img, bool erode, int w, int h, Convolution::PaddingMode padding) {
+    int padH = 0, padW = 0;
+    if (padding != Convolution::Padding_None) {
+        padH = (h - 1) / 2;
+        padW = (w - 1) / 2;
+    }
+    int rows = img.getRows();
+    int cols = img.getCols();
+    int outRows = rows + 2 * padH - h + 1;
+    int outCols = cols + 2 * padW - w + 1;
+    Image out(outRows > 0 ? outRows : 0, outCols > 0 ? outCols : 0);
+    for (int i = 0; i < out.getRows(); ++i) {
+        for (int j = 0; j < out.getCols(); ++j) {
+            double best = erode ? 1e300 : -1e300;
+            for (int m = 0; m < h; ++m) {
+                for (int n = 0; n < w; ++n) {
+                    int r = i - padH + m;
+                    int c = j - padW + n;
+                    double v;
+                    if (r >= 0 && r < rows && c >= 0 && c < cols) {
+                        v = img.getElement(r, c);
+                    } else if (padding == Convolution::Padding_Replicate) {
+                        v = img.getElement(r < 0 ? 0 : (r >= rows ? rows - 1 : r), c < 0 ? 0 : (c >= cols ? cols - 1 : c));
+                    } else {
+                        v = 0.0;
+                    }
+                    if (erode ? v < best : v > best) best = v;
+                }
+            }
+            out.setElement(i, j, best);
+        }
+    }
+    return out;
+}
+
+void testMorphologyFilter() {
+    cout << "\n=== Morphology Filter Test ===" << endl;
+
+    // 8 位输入走 unsigned char 路径，非整数输入走 double 路径
+    Image inputs[2];
+    inputs[0] = makeTestImage(71, 89, 6);
+    inputs[1] = scaledBy(inputs[0], 1.5);
+    for (int i = 0; i < inputs[1].getRows(); ++i) {
+        for (int j = 0; j < inputs[1].getCols(); ++j) {
+            inputs[1].setElement(i, j, inputs[1].getElement(i, j) + 0.25);
+        }
+    }
+    int widths[] = { 1, 3, 5, 7, 9, 3, 4 };
+    int heights[] = { 3, 3, 5, 7, 9, 7, 6 };
+    Convolution::PaddingMode paddings[] = { Convolution::Padding_Zero, Convolution::Padding_Replicate,
+                                            Convolution::Padding_None };
+    MorphologyFilter::Operation ops[] = { MorphologyFilter::Operation_Erode, MorphologyFilter::Operation_Dilate,
+                                          MorphologyFilter::Operation_Open, MorphologyFilter::Operation_Close };
+
+    double worst = 0.0;
+    double strideWorst = 0.0;
+    for (int in = 0; in < 2; ++in) {
+        for (int s = 0; s < 7; ++s) {
+            for (int p = 0; p < 3; ++p) {
+                Image eroded = bruteForceMorphology(inputs[in], true, widths[s], heights[s], paddings[p]);
+                Image dilated = bruteForceMorphology(inputs[in], false, widths[s], heights[s], paddings[p]);
+                Image expected[4];
+                expected[0] = eroded;
+                expected[1] = dilated;
+                expected[2] = bruteForceMorphology(eroded, false, widths[s], heights[s], paddings[p]);
+                expected[3] = bruteForceMorphology(dilated, true, widths[s], heights[s], paddings[p]);
+                for (int o = 0; o < 4; ++o) {
+                    MorphologyFilter filter(ops[o], widths[s], heights[s]);
+                    filter.setPadding(paddings[p]);
+                    double d = maxDifference(filter.apply(inputs[in]), expected[o]);
+                    if (d < 0.0 || d > worst) worst = (d < 0.0) ? 1e9 : d;
+
+                    // 步长输出是逐像素结果的抽样
+                    filter.setStride(2);
+                    Image strided = filter.apply(inputs[in]);
+                    Image sampled((expected[o].getRows() + 1) / 2, (expected[o].getCols() + 1) / 2);
+                    for (int i = 0; i < sampled.getRows(); ++i) {
+                        for (int j = 0; j < sampled.getCols(); ++j) {
+                            sampled.setElement(i, j, expected[o].getElement(2 * i, 2 * j));
+                        }
+                    }
+                    d = maxDifference(strided, sampled);
+                    if (d < 0.0 || d > strideWorst) strideWorst = (d < 0.0) ? 1e9 : d;
+                }
+            }
+        }
+    }
+    reportMatch("[Test 1] Erode / dilate / open / close vs brute force", worst, 0.0);
+    reportMatch("[Test 2] Stride 2 vs sampled brute force", strideWorst, 0.0);
+}
+
+void testAutotuner() {
+    cout << "\n=== Autotuner Test ===" << endl;
+    const string profile = "autotune_test.txt";
+    remove(profile.c_str());
+
+    Image img = makeTestImage(64, 80, 8);
+    // 可分离的 5x5 核：四种策略都可执行
+    double row[] = { 1.0, 4.0, 6.0, 4.0, 1.0 };
+    Matrix kernel(5, 5);
+    for (int m = 0; m < 5; ++m) {
+        for (int n = 0; n < 5; ++n) {
+            kernel.setElement(m, n, row[m] * row[n] / 256.0);
+        }
+    }
+    Convolution conv(kernel, 1, Convolution::Padding_Replicate);
+    Image reference = conv.apply(img);
+
+    // 强制策略：lookup 返回该策略，输出与直接按该策略执行一致；策略名可往返解析
+    KernelPlan::Strategy strategies[] = { KernelPlan::Strategy_Direct, KernelPlan::Strategy_Separable,
+                                          KernelPlan::Strategy_FixedSize, KernelPlan::Strategy_Sparse };
+    bool ok = true;
+    double worst = 0.0;
+    Autotuner forcedTuner;
+    for (int s = 0; s < 4; ++s) {
+        forcedTuner.forceStrategy(strategies[s]);
+        ok = ok && forcedTuner.isForced() &&
+             forcedTuner.lookup(conv.getPlan(), img, 1, Convolution::Padding_Replicate) == strategies[s];
+        ok = ok && Autotuner::parseStrategy(Autotuner::strategyName(strategies[s])) == strategies[s];
+        Image out = forcedTuner.apply(conv, img);
+        double d = maxDifference(out, Convolution::execute(conv.getPlan(), strategies[s], img, 1,
+                                                           Convolution::Padding_Replicate));
+        if (d < 0.0 || d > worst) worst = (d < 0.0) ? 1e9 : d;
+        d = maxDifference(out, reference);
+        if (d < 0.0 || d > 1e-9) ok = false;
+    }
+    forcedTuner.clearForcedStrategy();
+    ok = ok && !forcedTuner.isForced() && forcedTuner.getEntryCount() == 0;
+    try {
+        Autotuner::parseStrategy("no-such-strategy");
+        ok = false;
+    } catch (int e) {
+        ok = ok && e == -1;
+    }
+    cout << "[Test 1] Forced strategies and strategy names: " << (ok && worst == 0.0 ? "PASSED" : "FAILED") << endl;
+
+    // 调优结果写入配置文件，新的 Autotuner 读回后不再重新计时
+    KernelPlan::Strategy tuned;
+    {
+        Autotuner tuner(profile);
+        Image out = tuner.apply(conv, img);
+        tuned = tuner.lookup(conv.getPlan(), img, 1, Convolution::Padding_Replicate);
+        worst = maxDifference(out, reference);
+        ok = tuner.getEntryCount() == 1;
+    }
+    Autotuner reloaded;
+    ok = ok && reloaded.loadProfile(profile) && reloaded.getEntryCount() == 1 &&
+         reloaded.lookup(conv.getPlan(), img, 1, Convolution::Padding_Replicate) == tuned;
+    ok = ok && reloaded.saveProfile(profile) && Autotuner(profile).getEntryCount() == 1;
+    cout << "[Test 2] Profile save and reload: " << (ok && worst >= 0.0 && worst <= 1e-9 ? "PASSED" : "FAILED")
+         << endl;
+    remove(profile.c_str());
+}
+
+void testImagePyramid() {
+    cout << "\n=== Image Pyramid Test ===" << endl;
+
+    // 每层应等于对上一层做步长 2 的高斯卷积
+    Image img = makeTestImage(97, 130, 9);
+    Convolution::PaddingMode paddings[] = { Convolution::Padding_Zero, Convolution::Padding_Replicate,
+                                            Convolution::Padding_None };
+    double worst = 0.0;
+    double edgeWorst = 0.0;
+    for (int p = 0; p < 3; ++p) {
+        ImagePyramid pyramid(4, 5, 1.0);
+        pyramid.setPadding(paddings[p]);
+        pyramid.build(img);
+        Convolution gaussian(Convolution::createGaussianKernel(5, 1.0), 2, paddings[p]);
+        Image previous = img;
+        for (int l = 1; l < pyramid.getLevelCount(); ++l) {
+            Image expected = gaussian.apply(previous);
+            double d = maxDifference(pyramid.getLevel(l), expected);
+            if (d < 0.0 || d > worst) worst = (d < 0.0) ? 1e9 : d;
+            previous = pyramid.getLevel(l);
+        }
+
+        // 各层的边缘检测直接读取金字塔存储，结果与复制出的图像上检测一致
+        SobelDetector sobel;
+        sobel.setPadding(Convolution::Padding_Replicate);
+        for (int l = 0; l < pyramid.getLevelCount(); ++l) {
+            double d = maxDifference(pyramid.detectEdges(l, sobel), sobel.apply(pyramid.getLevel(l)));
+            if (d < 0.0 || d > edgeWorst) edgeWorst = (d < 0.0) ? 1e9 : d;
+        }
+    }
+    reportMatch("[Test 1] Levels vs stride-2 Gaussian convolution", worst, 1e-9);
+    reportMatch("[Test 2] detectEdges on level storage vs copied level", edgeWorst, 0.0);
+}
+
+void testImageResize() {
+    cout << "\n=== Image Resize Test ===" << endl;
+
+    // 同尺寸的双线性插值应原样返回
+    Image img = makeTestImage(74, 118, 10);
+    double d = maxDifference(img.resizeImage(img.getCols(), img.getRows(), Image::Resize_Bilinear), img);
+    reportMatch("[Test 1] Same-size bilinear is the identity", d, 0.0);
+
+    // 宽高各缩小一半的区域平均等于 2x2 块均值
+    Image half = img.resizeImage(img.getCols() / 2, img.getRows() / 2, Image::Resize_Area);
+    Image mean(img.getRows() / 2, img.getCols() / 2);
+    for (int i = 0; i < mean.getRows(); ++i) {
+        for (int j = 0; j < mean.getCols(); ++j) {
+            mean.setElement(i, j, (img.getElement(2 * i, 2 * j) + img.getElement(2 * i, 2 * j + 1) +
+                                   img.getElement(2 * i + 1, 2 * j) + img.getElement(2 * i + 1, 2 * j + 1)) / 4.0);
+        }
+    }
+    reportMatch("[Test 2] 2x area downscale vs 2x2 mean", maxDifference(half, mean), 1e-12);
+
+    // 并行与串行结果逐像素一致（放大与缩小、三种插值方式）
+    Image::ResizeFilter filters[] = { Image::Resize_Nearest, Image::Resize_Bilinear, Image::Resize_Area };
+    int sizes[][2] = { { 301, 257 }, { 47, 29 } };
+    double worst = 0.0;
+    for (int f = 0; f < 3; ++f) {
+        for (int s = 0; s < 2; ++s) {
+            Image serial = img.resizeImage(sizes[s][0], sizes[s][1], filters[f], false);
+            Image parallel = img.resizeImage(sizes[s][0], sizes[s][1], filters[f], true);
+            double diff = maxDifference(serial, parallel);
+            if (diff < 0.0 || diff > worst) worst = (diff < 0.0) ? 1e9 : diff;
+        }
+    }
+    reportMatch("[Test 3] Parallel resize vs serial", worst, 0.0);
+}
+
+// 比较各幅值模式（double / 8 位定点）的速度与相对精确 L2 的误差
+void benchmarkMagnitudeModes(const Image& img) {
+    cout << "\n=== Sobel Magnitude Mode Benchmark (" << img.getCols() << "x" << img.getRows() << ") ===" << endl;
+    const char* names[] = { "L2 ", "L1 ", "Max" };
+    const int runs = 5;
+
+    SobelDetector reference;
+    reference.setPadding(Convolution::Padding_Replicate);
+    Image exact = reference.apply(img);
+
+    for (int mode = 0; mode < 3; ++mode) {
+        for (int fixed = 0; fixed < 2; ++fixed) {
+            SobelDetector sobel;
+            sobel.setPadding(Convolution::Padding_Replicate);
+            sobel.setMagnitudeMode((SobelDetector::MagnitudeMode)mode);
+            sobel.setFixedPoint(fixed != 0);
+
+            Image result;
+            clock_t start = clock();
+            for (int r = 0; r < runs; ++r) {
+                result = sobel.apply(img);
+            }
+            double ms = 1000.0 * (double)(clock() - start) / CLOCKS_PER_SEC / runs;
+
+            // 按 savePGM 的量化结果比较（截断并钳位到 0-255）
+            double err = 0.0;
+            for (int i = 0; i < result.getRows(); ++i) {
+                for (int j = 0; j < result.getCols(); ++j) {
+                    double a = result.getElement(i, j);
+                    double b = exact.getElement(i, j);
+                    int pa = a > 255 ? 255 : (int)a;
+                    int pb = b > 255 ? 255 : (int)b;
+                    err += pa > pb ? pa - pb : pb - pa;
+                }
+            }
+            err /= (double)result.getRows() * result.getCols();
+
+            cout << names[mode] << (fixed ? " fixed " : " double") << ": " << ms
+                 << " ms/frame, mean |error| vs L2 (saved levels) = " << err << endl;
+        }
+    }
+}
+
 // Helper to create a sample image for demonstration
 void createSampleImage(const string& filename) {
     int width = 200;
@@ -89,17 +787,34 @@ int main(int argc, char* argv[]) {
     string inputPath;
     string outputPath;
     double threshold = -1.0;
+    bool autoThreshold = false;
     bool invert = false;
 
     if (argc < 3) {
-        cout << "Usage: " << argv[0] << " <input_pgm> <output_pgm> [threshold] [invert]" << endl;
-        cout << "  threshold: 0-255, or -1 to disable" << endl;
+        cout << "Usage: " << argv[0] << " <input_pgm> <output_pgm|output_pbm> [threshold] [invert]" << endl;
+        cout << "  output_pbm: a .pbm output is saved as a 1-bit P4 mask (needs a threshold)" << endl;
+        cout << "  threshold: 0-255, 'auto' for Otsu, or -1 to disable" << endl;
         cout << "  invert: 'invert', 'true', or '1' to invert output (white background)" << endl;
         cout << "No arguments provided. Running internal tests and generating sample image..." << endl;
         
         testMatrixExceptions();
+        testSequenceFilter();
+        testSobelFixedPoint();
+        testMedianFilter();
+        testVectorConvolve();
+        testTiledImage();
+        testFilterBank();
+        testMorphologyFilter();
+        testAutotuner();
+        testImagePyramid();
+        testImageResize();
 
         createSampleImage("sample.pgm");
+        Image benchImage;
+        if (benchImage.loadPGM("sample.pgm")) {
+            benchmarkMagnitudeModes(benchImage.resizeImage(800, 800));
+        }
+
         inputPath = "sample.pgm";
         outputPath = "sample_edge.pgm";
         threshold = 100.0; // Demo threshold
@@ -107,7 +822,12 @@ int main(int argc, char* argv[]) {
         inputPath = argv[1];
         outputPath = argv[2];
         if (argc > 3) {
-            threshold = atof(argv[3]);
+            string arg3 = argv[3];
+            if (arg3 == "auto") {
+                autoThreshold = true;
+            } else {
+                threshold = atof(argv[3]);
+            }
         }
         if (argc > 4) {
             string arg4 = argv[4];
@@ -129,8 +849,13 @@ int main(int argc, char* argv[]) {
         cout << "Applying Sobel edge detection..." << endl;
         SobelDetector sobel;
         sobel.setPadding(Convolution::Padding_Replicate);
+        // 结果直接保存为 PGM，8 位输入可走整数路径
+        sobel.setFixedPoint(true);
         
-        if (threshold >= 0) {
+        if (autoThreshold) {
+            cout << "Using automatic (Otsu) threshold." << endl;
+            sobel.setAutoThreshold();
+        } else if (threshold >= 0) {
             cout << "Using threshold: " << threshold << endl;
             sobel.setThreshold(threshold);
         } else {
@@ -142,7 +867,32 @@ int main(int argc, char* argv[]) {
             sobel.setInvert(true);
         }
 
-        Image result = sobel.apply(img);
+        // 阈值化结果只有 0/255，.pbm 输出直接保存为位掩码
+        bool maskOutput = outputPath.size() > 4 && outputPath.compare(outputPath.size() - 4, 4, ".pbm") == 0;
+        if (maskOutput && !autoThreshold && threshold < 0) {
+            cerr << "Error: PBM output requires a threshold." << endl;
+            return 1;
+        }
+
+        double usedThreshold = -1.0;
+        if (maskOutput) {
+            BitMask mask = sobel.applyMask(img, &usedThreshold);
+            if (autoThreshold) {
+                cout << "Selected threshold: " << usedThreshold << endl;
+            }
+            cout << "Saving mask to " << outputPath << "..." << endl;
+            if (!mask.savePBM(outputPath)) {
+                cerr << "Error: Failed to save image file: " << outputPath << endl;
+                return 1;
+            }
+            cout << "Processing complete successfully." << endl;
+            return 0;
+        }
+
+        Image result = sobel.apply(img, &usedThreshold);
+        if (autoThreshold) {
+            cout << "Selected threshold: " << usedThreshold << endl;
+        }
 
         cout << "Saving result to " << outputPath << "..." << endl;
         if (!result.savePGM(outputPath)) {